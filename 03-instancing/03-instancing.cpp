@@ -6,13 +6,21 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <windows.h>
+#include <chrono>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include "LoadShaders.h"
 #include "vbm.h"
+#include "instances.h"
+#include "scene.h"
+#include "capture.h"
+#include "memtrack.h"
+#include "governor.h"
 
 float aspect;
 GLuint update_prog;
@@ -22,9 +30,58 @@ GLuint xfb;
 
 GLuint weight_vbo;
 GLuint color_vbo;
+GLuint anim_vbo;
 GLuint render_prog;
 GLint render_model_matrix_loc;
 GLint render_projection_matrix_loc;
+GLint render_animated_loc;
+
+GLuint depth_prog;
+GLint depth_model_matrix_loc;
+GLint depth_projection_matrix_loc;
+GLint depth_animated_loc;
+
+// Keyframe animation across the VBM frames, toggled with 'A'
+bool animate = true;
+
+// Depth-only pre-pass with front-to-back instance ordering, toggled with 'P'
+bool depth_prepass = false;
+
+// GL_ARB_pipeline_statistics_query, used to count fragment shader invocations
+GLuint stats_query;
+bool stats_query_pending = false;
+ULONGLONG stats_last_report;
+
+// Frame capture to capture_NNNNN.ppm, toggled with 'C' or started with -capture
+FrameCapture capture;
+
+// Periodic dump of the memory accounting, toggled with 'M'
+#define MEMORY_DUMP_INTERVAL 5000
+bool memory_dump = false;
+ULONGLONG memory_last_dump;
+
+// Frame-time governor trading far instances and instance count for frame
+// time, toggled with 'G'; the target is set with -target <ms>
+FrameGovernor governor;
+bool governor_enabled = false;
+ULONGLONG governor_last_report;
+
+// GPU frame times come from a small ring of timer queries that are only
+// read back once they're done, a few frames late. Without
+// GL_ARB_timer_query the governor only sees CPU time.
+#define GPU_TIMER_QUERIES 4
+bool gpu_timer_supported = false;
+GLuint gpu_timer_queries[GPU_TIMER_QUERIES];
+unsigned int gpu_timer_head = 0;
+unsigned int gpu_timer_count = 0;
+
+// Synthetic load for the governor to react to, toggled with 'L': the shading
+// pass is repeated up to LOAD_RAMP_PASSES extra times, ramping up and back
+// down over LOAD_RAMP_PERIOD ms
+#define LOAD_RAMP_PASSES 8
+#define LOAD_RAMP_PERIOD 30000
+bool load_ramp = false;
+ULONGLONG load_ramp_start;
 
 GLuint geometry_tex;
 
@@ -40,31 +97,56 @@ VBObject object;
 
 ULONGLONG m_appStartTime;
 
-#define INSTANCE_COUNT 200
+glm::vec4 instance_colors[INSTANCE_COUNT];
 
-static unsigned int seed = 0x13371337;
+ANIMATION_CLIP anim_clips[MAX_ANIMATION_CLIPS];
+unsigned int anim_clip_count;
+unsigned int instance_clip[INSTANCE_COUNT];
+float instance_time_offset[INSTANCE_COUNT];
 
-static inline float random_float()
+// Appends the instanced attributes to the currently bound vertex array object
+static void SetupInstanceAttribs()
 {
-    float res;
-    unsigned int tmp;
+    glBindBuffer(GL_ARRAY_BUFFER, weight_vbo);
+
+    // Here is the instanced vertex attribute - set the divisor
+    glVertexAttribDivisor(3, 1);
+    // It's otherwise the same as any other vertex attribute - set the pointer and enable it
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(3);
 
-    seed *= 16807;
+    // Same with the instance color array
+    glBindBuffer(GL_ARRAY_BUFFER, color_vbo);
 
-    tmp = seed ^ (seed >> 4) ^ (seed << 15);
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(4);
 
-    *((unsigned int *) &res) = (tmp >> 9) | 0x3F800000;
+    // And the animation state (clip, frame, phase)
+    glBindBuffer(GL_ARRAY_BUFFER, anim_vbo);
 
-    return (res - 1.0f);
+    glVertexAttribDivisor(5, 1);
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(5);
 }
 
-static glm::vec3 random_vector(float minmag = 0.0f, float maxmag = 1.0f)
+// Uploads the per-frame vertex count and the clip table to a program that
+// includes the keyframe animation path
+static void SetAnimationUniforms(GLuint prog)
 {
-    glm::vec3 randomvec(random_float() * 2.0f - 1.0f, random_float() * 2.0f - 1.0f, random_float() * 2.0f - 1.0f);
-    randomvec = normalize(randomvec);
-    randomvec *= (random_float() * (maxmag - minmag) + minmag);
+    GLint clips[MAX_ANIMATION_CLIPS * 2];
+    unsigned int n;
 
-    return randomvec;
+    for (n = 0; n < MAX_ANIMATION_CLIPS; n++)
+    {
+        clips[n * 2 + 0] = n < anim_clip_count ? anim_clips[n].first_frame : 0;
+        clips[n * 2 + 1] = n < anim_clip_count ? anim_clips[n].frame_count : 1;
+    }
+
+    glUseProgram(prog);
+    glUniform1i(glGetUniformLocation(prog, "frame_vertices"), object.GetVertexCount(0));
+    glUniform2iv(glGetUniformLocation(prog, "anim_clips"), MAX_ANIMATION_CLIPS, clips);
+    glUniform1i(glGetUniformLocation(prog, "frames"), 0);
 }
 
 void Initialize()
@@ -85,49 +167,107 @@ void Initialize()
     // "model_matrix" is actually an array of 4 matrices
     render_model_matrix_loc = glGetUniformLocation(render_prog, "model_matrix");
     render_projection_matrix_loc = glGetUniformLocation(render_prog, "projection_matrix");
+    render_animated_loc = glGetUniformLocation(render_prog, "animated");
+
+    ShaderInfo depth_shader_info[] =
+    {
+        { GL_VERTEX_SHADER, "depth.vs.glsl" },
+        { GL_NONE, NULL }
+    };
+
+    depth_prog = LoadShaders(depth_shader_info);
+
+    depth_model_matrix_loc = glGetUniformLocation(depth_prog, "model_matrix");
+    depth_projection_matrix_loc = glGetUniformLocation(depth_prog, "projection_matrix");
+    depth_animated_loc = glGetUniformLocation(depth_prog, "animated");
+
+    if (GLEW_ARB_pipeline_statistics_query)
+    {
+        glGenQueries(1, &stats_query);
+        stats_last_report = m_appStartTime;
+    }
+
+    if (GLEW_VERSION_3_3 || GLEW_ARB_timer_query)
+    {
+        glGenQueries(GPU_TIMER_QUERIES, gpu_timer_queries);
+        gpu_timer_supported = true;
+    }
+
+    GOVERNOR_SETTINGS governor_settings;
+
+    GetDefaultGovernorSettings(&governor_settings);
+    governor_settings.min_instances = INSTANCE_COUNT / 10;
+    governor_settings.max_instances = INSTANCE_COUNT;
+    governor.Configure(governor_settings);
 
     // Load the object
     object.LoadFromVBM("armadillo_low.vbm", 0, 1, 2);
 
-    // Bind its vertex array object so that we can append the instanced attributes
-    object.BindVertexArray();
+    // VBM files don't carry clip metadata, so play the whole frame sequence
+    // plus each half of it at different rates. Every instance picks a clip
+    // and a start time of its own.
+    anim_clips[0].first_frame = 0;
+    anim_clips[0].frame_count = object.GetFrameCount();
+    anim_clips[0].frames_per_second = 24.0f;
+    anim_clip_count = 1;
 
-    // Generate the colors of the objects
-    glm::vec4 colors[INSTANCE_COUNT];
+    if (object.GetFrameCount() >= 4)
+    {
+        anim_clips[1].first_frame = 0;
+        anim_clips[1].frame_count = object.GetFrameCount() / 2;
+        anim_clips[1].frames_per_second = 30.0f;
+        anim_clips[2].first_frame = anim_clips[1].frame_count;
+        anim_clips[2].frame_count = object.GetFrameCount() - anim_clips[1].frame_count;
+        anim_clips[2].frames_per_second = 15.0f;
+        anim_clip_count = 3;
+    }
 
     for (int n = 0; n < INSTANCE_COUNT; n++)
     {
-        float a = float(n) / 4.0f;
-        float b = float(n) / 5.0f;
-        float c = float(n) / 6.0f;
-
-        colors[n][0] = 0.5f * (sinf(a + 1.0f) + 1.0f);
-        colors[n][1] = 0.5f * (sinf(b + 2.0f) + 1.0f);
-        colors[n][2] = 0.5f * (sinf(c + 3.0f) + 1.0f);
-        colors[n][3] = 1.0f;
+        instance_clip[n] = n % anim_clip_count;
+        instance_time_offset[n] = RandomFloat() * 10.0f;
     }
 
+    SetAnimationUniforms(render_prog);
+    SetAnimationUniforms(depth_prog);
+
+    // Generate the colors of the objects
+    glm::vec4 * colors = instance_colors;
+
+    GenerateInstanceColors(colors, INSTANCE_COUNT);
+
     // Create and allocate the VBO to hold the weights
     // Notice that we use the 'colors' array as the initial data, but only because
     // we know it's the same size.
     glGenBuffers(1, &weight_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, weight_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(colors), colors, GL_DYNAMIC_DRAW);
-
-    // Here is the instanced vertex attribute - set the divisor
-    glVertexAttribDivisor(3, 1);
-    // It's otherwise the same as any other vertex attribute - set the pointer and enable it
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(3);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(instance_colors), colors, GL_DYNAMIC_DRAW);
+    TrackGLBuffer(weight_vbo, MEMORY_GPU_INSTANCE, sizeof(instance_colors));
 
-    // Same with the instance color array
+    // The colors only change when the instances get reordered for the pre-pass
     glGenBuffers(1, &color_vbo);
     glBindBuffer(GL_ARRAY_BUFFER, color_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(colors), colors, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(instance_colors), colors, GL_DYNAMIC_DRAW);
+    TrackGLBuffer(color_vbo, MEMORY_GPU_INSTANCE, sizeof(instance_colors));
 
-    glVertexAttribDivisor(4, 1);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 0, NULL);
-    glEnableVertexAttribArray(4);
+    // Animation state is rewritten every frame
+    glGenBuffers(1, &anim_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, anim_vbo);
+    glBufferData(GL_ARRAY_BUFFER, INSTANCE_COUNT * sizeof(glm::vec3), NULL, GL_DYNAMIC_DRAW);
+    TrackGLBuffer(anim_vbo, MEMORY_GPU_INSTANCE, INSTANCE_COUNT * sizeof(glm::vec3));
+
+    // Bind the object's vertex array objects so that we can append the instanced attributes
+    object.BindVertexArray();
+    SetupInstanceAttribs();
+
+    object.BindDepthVertexArray();
+    SetupInstanceAttribs();
+
+    if (object.HasFrameAnimation())
+    {
+        object.BindAnimationVertexArray();
+        SetupInstanceAttribs();
+    }
 
     // Done (unbind the object's VAO)
     glBindVertexArray(0);
@@ -138,11 +278,33 @@ static inline int min(int a, int b)
     return a < b ? a : b;
 }
 
+// Returns the time of the oldest frame in the timer ring if it has finished,
+// or a negative value if there isn't one or timer queries aren't supported
+static float ReadGPUFrameTime()
+{
+    if (!gpu_timer_supported || gpu_timer_count == 0)
+        return -1.0f;
+
+    GLuint available = 0;
+    glGetQueryObjectuiv(gpu_timer_queries[gpu_timer_head], GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (!available)
+        return -1.0f;
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(gpu_timer_queries[gpu_timer_head], GL_QUERY_RESULT, &elapsed);
+    gpu_timer_head = (gpu_timer_head + 1) % GPU_TIMER_QUERIES;
+    gpu_timer_count--;
+
+    return float(elapsed) / 1000000.0f;
+}
+
 void Display()
 {
+    std::chrono::steady_clock::time_point cpu_start = std::chrono::steady_clock::now();
     ULONGLONG currentTime = ::GetTickCount64();
     unsigned int app_time = (unsigned int)(currentTime - m_appStartTime);
-    float t = float(app_time & 0x3FFFF) / float(0x3FFFF);
+    float t = SceneTime(app_time);
     static float q = 0.0f;
     static const glm::vec3 X(1.0f, 0.0f, 0.0f);
     static const glm::vec3 Y(0.0f, 1.0f, 0.0f);
@@ -152,63 +314,299 @@ void Display()
     // Set weights for each instance
     glm::vec4 weights[INSTANCE_COUNT];
 
-    for (n = 0; n < INSTANCE_COUNT; n++)
+    GenerateInstanceWeights(t, weights, INSTANCE_COUNT);
+
+    // Set four model matrices
+    glm::mat4 model_matrix[4];
+
+    GenerateModelMatrices(t, model_matrix);
+
+    // Set up the projection matrix
+    glm::mat4 projection_matrix(GenerateProjectionMatrix(aspect));
+
+    // Advance the animation of every instance
+    bool animating = animate && object.HasFrameAnimation();
+    glm::vec3 anim[INSTANCE_COUNT];
+
+    if (animating)
+        ComputeInstanceAnimation(anim_clips, instance_clip, instance_time_offset, INSTANCE_COUNT, float(app_time) / 1000.0f, anim);
+
+    // With the pre-pass on, draw the instances roughly front to back so that
+    // the pre-pass itself gets early depth rejection too. The governor needs
+    // the same order so that it can drop instances from the far end.
+    static bool colors_reordered = false;
+    unsigned int draw_count = INSTANCE_COUNT;
+
+    if (depth_prepass || governor_enabled)
     {
-        float a = float(n) / 4.0f;
-        float b = float(n) / 5.0f;
-        float c = float(n) / 6.0f;
+        float depth[INSTANCE_COUNT];
+        unsigned int order[INSTANCE_COUNT];
+        unsigned int bucket_end[INSTANCE_DEPTH_BUCKETS];
+        glm::vec4 reordered[INSTANCE_COUNT];
+
+        ComputeInstanceDepths(projection_matrix, model_matrix, weights, INSTANCE_COUNT, depth);
+        SortInstancesFrontToBack(depth, INSTANCE_COUNT, order, bucket_end);
+
+        if (governor_enabled)
+        {
+            draw_count = CountInstancesWithinDepth(bucket_end, governor.GetFarCutoff());
+            unsigned int cap = governor.GetInstanceCap();
+
+            if (draw_count > cap)
+                draw_count = cap;
+        }
+
+        for (n = 0; n < INSTANCE_COUNT; n++)
+            reordered[n] = instance_colors[order[n]];
+
+        glBindBuffer(GL_ARRAY_BUFFER, color_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(reordered), reordered, GL_DYNAMIC_DRAW);
+        colors_reordered = true;
+
+        for (n = 0; n < INSTANCE_COUNT; n++)
+            reordered[n] = weights[order[n]];
+
+        memcpy(weights, reordered, sizeof(weights));
+
+        if (animating)
+        {
+            glm::vec3 reordered_anim[INSTANCE_COUNT];
+
+            for (n = 0; n < INSTANCE_COUNT; n++)
+                reordered_anim[n] = anim[order[n]];
 
-        weights[n][0] = 0.5f * (sinf(t * 6.28318531f * 8.0f + a) + 1.0f);
-        weights[n][1] = 0.5f * (sinf(t * 6.28318531f * 26.0f + b) + 1.0f);
-        weights[n][2] = 0.5f * (sinf(t * 6.28318531f * 21.0f + c) + 1.0f);
-        weights[n][3] = 0.5f * (sinf(t * 6.28318531f * 13.0f + a + b) + 1.0f);
+            memcpy(anim, reordered_anim, sizeof(anim));
+        }
+    }
+    else if (colors_reordered)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, color_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(instance_colors), instance_colors, GL_DYNAMIC_DRAW);
+        colors_reordered = false;
     }
 
     // Bind the weight VBO and change its data
     glBindBuffer(GL_ARRAY_BUFFER, weight_vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(weights), weights, GL_DYNAMIC_DRAW);
 
-    // Clear
+    if (animating)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, anim_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(anim), anim, GL_DYNAMIC_DRAW);
+    }
+
+    // Clear (the depth mask has to be on for the depth clear to happen)
+    glDepthMask(GL_TRUE);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Setup
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
+
+    // Time the whole frame on the GPU unless the ring is still full of
+    // queries that haven't come back
+    float gpu_ms = ReadGPUFrameTime();
+    bool issue_timer = gpu_timer_supported && gpu_timer_count < GPU_TIMER_QUERIES;
+
+    if (issue_timer)
+        glBeginQuery(GL_TIME_ELAPSED, gpu_timer_queries[(gpu_timer_head + gpu_timer_count) % GPU_TIMER_QUERIES]);
+
+    if (depth_prepass)
+    {
+        // Lay down depth only, using the position-only vertex stream
+        glUseProgram(depth_prog);
+        glUniformMatrix4fv(depth_model_matrix_loc, 4, GL_FALSE, &model_matrix[0][0][0]);
+        glUniformMatrix4fv(depth_projection_matrix_loc, 1, GL_FALSE, &projection_matrix[0][0]);
+        glUniform1i(depth_animated_loc, animating);
+
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthFunc(GL_LESS);
+        if (animating)
+            object.RenderAnimated(draw_count);
+        else
+            object.RenderDepth(0, draw_count);
+
+        // The shading pass then only passes the depth test for visible fragments
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_FALSE);
+    }
+
     glDepthFunc(GL_LEQUAL);
 
     // Activate instancing program
     glUseProgram(render_prog);
 
-    // Set four model matrices
-    glm::mat4 model_matrix[4];
+    glUniformMatrix4fv(render_model_matrix_loc, 4, GL_FALSE, &model_matrix[0][0][0]);
+    glUniformMatrix4fv(render_projection_matrix_loc, 1, GL_FALSE, &projection_matrix[0][0]);
+    glUniform1i(render_animated_loc, animating);
+
+    // Only one statistics query is kept in flight; the result is picked up
+    // whenever it becomes available so that we never stall on it
+    bool issue_query = false;
 
-    for (n = 0; n < 4; n++)
+    if (stats_query != 0)
     {
-        model_matrix[n] = (glm::scale(glm::mat4(), glm::vec3(5.0f, 5.0f, 5.0f)) *
-                           glm::rotate(glm::mat4(), glm::radians(t * 360.0f * 40.0f + float(n + 1) * 29.0f), glm::vec3(0.0f, 1.0f, 0.0f)) *
-                           glm::rotate(glm::mat4(), glm::radians(t * 360.0f * 20.0f + float(n + 1) * 35.0f), glm::vec3(0.0f, 0.0f, 1.0f)) *
-                           glm::rotate(glm::mat4(), glm::radians(t * 360.0f * 30.0f + float(n + 1) * 67.0f), glm::vec3(0.0f, 1.0f, 0.0f)) *
-                           glm::translate(glm::mat4(), glm::vec3((float)n * 10.0f - 15.0f, 0.0f, 0.0f)) *
-                           glm::scale(glm::mat4(), glm::vec3(0.01f, 0.01f, 0.01f)));
+        if (stats_query_pending)
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(stats_query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if (available)
+            {
+                GLuint64 invocations = 0;
+                glGetQueryObjectui64v(stats_query, GL_QUERY_RESULT, &invocations);
+                stats_query_pending = false;
+
+                if (currentTime - stats_last_report >= 1000)
+                {
+                    printf("Fragment shader invocations: %llu (depth pre-pass %s)\n",
+                           (unsigned long long)invocations, depth_prepass ? "on" : "off");
+                    stats_last_report = currentTime;
+                }
+            }
+        }
+
+        issue_query = !stats_query_pending;
     }
 
-    glUniformMatrix4fv(render_model_matrix_loc, 4, GL_FALSE, &model_matrix[0][0][0]);
+    if (issue_query)
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, stats_query);
 
-    // Set up the projection matrix
-    glm::mat4 projection_matrix(glm::frustum(-1.0f, 1.0f, -aspect, aspect, 1.0f, 5000.0f) * glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -100.0f)));
+    // Render the instances, each playing its own animation if there is one
+    if (animating)
+        object.RenderAnimated(draw_count);
+    else
+        object.Render(0, draw_count);
 
-    glUniformMatrix4fv(render_projection_matrix_loc, 1, GL_FALSE, &projection_matrix[0][0]);
+    if (issue_query)
+    {
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+        stats_query_pending = true;
+    }
+
+    if (load_ramp)
+    {
+        // Triangle wave from no extra passes up to LOAD_RAMP_PASSES and back
+        unsigned int phase = (unsigned int)((currentTime - load_ramp_start) % LOAD_RAMP_PERIOD);
+        unsigned int ramp = phase < LOAD_RAMP_PERIOD / 2 ? phase : LOAD_RAMP_PERIOD - phase;
+        unsigned int passes = ramp * LOAD_RAMP_PASSES * 2 / LOAD_RAMP_PERIOD;
+
+        for (unsigned int pass = 0; pass < passes; pass++)
+        {
+            if (animating)
+                object.RenderAnimated(draw_count);
+            else
+                object.Render(0, draw_count);
+        }
+    }
+
+    if (issue_timer)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpu_timer_count++;
+    }
+
+    if (governor_enabled)
+    {
+        float cpu_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - cpu_start).count();
+
+        governor.Update(cpu_ms, gpu_ms);
+
+        if (currentTime - governor_last_report >= 1000)
+        {
+            governor.PrintTelemetry();
+            governor_last_report = currentTime;
+        }
+    }
 
-    // Render INSTANCE_COUNT objects
-    object.Render(0, INSTANCE_COUNT);
+    if (memory_dump && currentTime - memory_last_dump >= MEMORY_DUMP_INTERVAL)
+    {
+        DumpMemoryUsage(stdout);
+        memory_last_dump = currentTime;
+    }
+}
+
+void KeyPress(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    switch (key)
+    {
+        case GLFW_KEY_P:
+            depth_prepass = !depth_prepass;
+            printf("Depth pre-pass %s\n", depth_prepass ? "enabled" : "disabled");
+            break;
+        case GLFW_KEY_A:
+            animate = !animate;
+            printf("Animation %s\n", animate ? "enabled" : "disabled");
+            break;
+        case GLFW_KEY_M:
+            memory_dump = !memory_dump;
+            printf("Memory dump %s\n", memory_dump ? "enabled" : "disabled");
+            if (memory_dump)
+            {
+                DumpMemoryUsage(stdout);
+                memory_last_dump = ::GetTickCount64();
+            }
+            break;
+        case GLFW_KEY_G:
+            governor_enabled = !governor_enabled;
+            printf("Frame-time governor %s (target %.1f ms)\n", governor_enabled ? "enabled" : "disabled",
+                   governor.GetSettings().target_ms);
+            if (governor_enabled)
+            {
+                governor.Reset();
+                governor_last_report = ::GetTickCount64();
+            }
+            break;
+        case GLFW_KEY_L:
+            load_ramp = !load_ramp;
+            printf("Load ramp %s\n", load_ramp ? "enabled" : "disabled");
+            load_ramp_start = ::GetTickCount64();
+            break;
+        case GLFW_KEY_C:
+            if (capture.IsCapturing())
+            {
+                capture.Stop();
+            }
+            else
+            {
+                int width, height;
+                glfwGetFramebufferSize(window, &width, &height);
+                capture.Start("capture_", width, height);
+            }
+            break;
+    }
 }
 
 void Finalize(void)
 {
     glUseProgram(0);
     glDeleteProgram(update_prog);
+    glDeleteProgram(depth_prog);
+    if (stats_query != 0)
+        glDeleteQueries(1, &stats_query);
+    if (gpu_timer_supported)
+        glDeleteQueries(GPU_TIMER_QUERIES, gpu_timer_queries);
     glDeleteVertexArrays(2, vao);
     glDeleteBuffers(2, vbo);
+
+    UntrackGLBuffer(weight_vbo);
+    UntrackGLBuffer(color_vbo);
+    UntrackGLBuffer(anim_vbo);
+    glDeleteBuffers(1, &weight_vbo);
+    glDeleteBuffers(1, &color_vbo);
+    glDeleteBuffers(1, &anim_vbo);
+    object.Free();
+
+    // Everything has been released at this point, so anything left over
+    // is a leak
+    if (GetCPUMemoryBytes() != 0 || GetGPUMemoryBytes() != 0)
+    {
+        printf("Memory still allocated at exit:\n");
+        DumpMemoryUsage(stdout);
+    }
 }
 
 int main(int argc, char** argv)
@@ -222,14 +620,41 @@ int main(int argc, char** argv)
     glfwMakeContextCurrent(window);
     glewExperimental = GL_TRUE;
     glewInit();
+    glfwSetKeyCallback(window, KeyPress);
     
     Initialize();
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-capture") == 0)
+        {
+            int framebuffer_width, framebuffer_height;
+            glfwGetFramebufferSize(window, &framebuffer_width, &framebuffer_height);
+            capture.Start("capture_", framebuffer_width, framebuffer_height);
+        }
+        else if (strcmp(argv[arg], "-target") == 0 && arg + 1 < argc)
+        {
+            GOVERNOR_SETTINGS governor_settings = governor.GetSettings();
+
+            governor_settings.target_ms = (float)atof(argv[++arg]);
+            if (governor_settings.target_ms > 0.0f)
+            {
+                governor.Configure(governor_settings);
+                governor.Reset();
+                governor_enabled = true;
+                governor_last_report = ::GetTickCount64();
+            }
+        }
+    }
+
     while (!glfwWindowShouldClose(window))
     {
         Display();
+        capture.CaptureFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    capture.Stop();
     Finalize();
 
     glfwDestroyWindow(window);
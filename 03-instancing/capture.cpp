@@ -0,0 +1,332 @@
+#include "capture.h"
+#include "memtrack.h"
+
+#include <stdio.h>
+#include <string.h>
+
+FrameCapture::FrameCapture(void)
+    : m_capturing(false),
+      m_width(0),
+      m_height(0),
+      m_ring_head(0),
+      m_ring_count(0),
+      m_frame(0),
+      m_quit(false),
+      m_written(0),
+      m_write_failures(0),
+      m_write_latency_ms(0.0),
+      m_retired(0),
+      m_dropped(0),
+      m_readback_latency_frames(0),
+      m_readback_latency_ms(0.0),
+      m_capture_ms(0.0),
+      m_frame_ms(0.0)
+{
+    memset(m_pack_buffers, 0, sizeof(m_pack_buffers));
+}
+
+FrameCapture::~FrameCapture(void)
+{
+    Stop();
+}
+
+bool FrameCapture::Start(const char * prefix, int width, int height)
+{
+    unsigned int i;
+
+    if (m_capturing || width <= 0 || height <= 0)
+        return false;
+
+    m_prefix = prefix;
+    m_width = width;
+    m_height = height;
+
+    // BGRA is the native layout of most desktop framebuffers, which keeps
+    // the readback a straight copy on the GPU
+    const size_t size = (size_t)width * height * 4;
+
+    glGenBuffers(CAPTURE_RING_SIZE, m_pack_buffers);
+    for (i = 0; i < CAPTURE_RING_SIZE; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pack_buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        TrackGLBuffer(m_pack_buffers[i], MEMORY_GPU_STAGING, size);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_free_buffers.clear();
+    for (i = 0; i < CAPTURE_QUEUE_SIZE; i++) {
+        m_pixels[i].resize(size);
+        MemoryAllocated(MEMORY_CPU_STAGING, size);
+        m_free_buffers.push_back(i);
+    }
+
+    m_ring_head = 0;
+    m_ring_count = 0;
+    m_frame = 0;
+    m_quit = false;
+    m_written = 0;
+    m_write_failures = 0;
+    m_write_latency_ms = 0.0;
+    m_retired = 0;
+    m_dropped = 0;
+    m_readback_latency_frames = 0;
+    m_readback_latency_ms = 0.0;
+    m_capture_ms = 0.0;
+    m_frame_ms = 0.0;
+    m_last_report = clock::now();
+
+    m_writer = std::thread(&FrameCapture::WriterThread, this);
+    m_capturing = true;
+
+    printf("Capturing frames to %s*.ppm\n", m_prefix.c_str());
+
+    return true;
+}
+
+void FrameCapture::Stop(void)
+{
+    unsigned int waits = 0;
+    unsigned int i;
+
+    if (!m_capturing)
+        return;
+
+    // Everything already read back still gets written, unless the GPU
+    // doesn't get there in time
+    while (m_ring_count) {
+        GLenum status = glClientWaitSync(m_ring[m_ring_head].fence, GL_SYNC_FLUSH_COMMANDS_BIT, CAPTURE_WAIT_TIMEOUT);
+
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            Retire();
+        } else if (status == GL_WAIT_FAILED || ++waits == CAPTURE_STOP_WAITS) {
+            while (m_ring_count) {
+                glDeleteSync(m_ring[m_ring_head].fence);
+                m_ring_head = (m_ring_head + 1) % CAPTURE_RING_SIZE;
+                m_ring_count--;
+                m_dropped++;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_queue_ready.notify_one();
+    m_writer.join();
+
+    for (i = 0; i < CAPTURE_RING_SIZE; i++)
+        UntrackGLBuffer(m_pack_buffers[i]);
+    glDeleteBuffers(CAPTURE_RING_SIZE, m_pack_buffers);
+    memset(m_pack_buffers, 0, sizeof(m_pack_buffers));
+    for (i = 0; i < CAPTURE_QUEUE_SIZE; i++) {
+        MemoryFreed(MEMORY_CPU_STAGING, m_pixels[i].size());
+        std::vector<unsigned char>().swap(m_pixels[i]);
+    }
+
+    Report();
+    printf("Capture stopped\n");
+
+    m_capturing = false;
+}
+
+void FrameCapture::CaptureFrame(void)
+{
+    if (!m_capturing)
+        return;
+
+    clock::time_point start = clock::now();
+
+    if (m_frame > 0)
+        m_frame_ms += std::chrono::duration<double, std::milli>(start - m_last_frame).count();
+    m_last_frame = start;
+
+    // Hand over every readback that has completed, oldest first. Nothing
+    // here ever waits on the GPU.
+    while (m_ring_count) {
+        GLenum status = glClientWaitSync(m_ring[m_ring_head].fence, 0, 0);
+
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+
+        Retire();
+    }
+
+    if (m_ring_count == CAPTURE_RING_SIZE) {
+        // The GPU is too far behind to take another readback
+        m_dropped++;
+    } else {
+        unsigned int slot = (m_ring_head + m_ring_count) % CAPTURE_RING_SIZE;
+        Readback & readback = m_ring[slot];
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pack_buffers[slot]);
+        glReadBuffer(GL_BACK);
+        glReadPixels(0, 0, m_width, m_height, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.frame = m_frame;
+        readback.issued = start;
+        m_ring_count++;
+    }
+
+    m_frame++;
+
+    clock::time_point end = clock::now();
+
+    m_capture_ms += std::chrono::duration<double, std::milli>(end - start).count();
+
+    if (end - m_last_report >= std::chrono::seconds(1)) {
+        Report();
+        m_last_report = end;
+    }
+}
+
+void FrameCapture::Retire(void)
+{
+    Readback & readback = m_ring[m_ring_head];
+    const size_t size = (size_t)m_width * m_height * 4;
+    unsigned int buffer = CAPTURE_QUEUE_SIZE;
+
+    glDeleteSync(readback.fence);
+
+    m_retired++;
+    m_readback_latency_frames += m_frame - readback.frame;
+    m_readback_latency_ms += std::chrono::duration<double, std::milli>(clock::now() - readback.issued).count();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free_buffers.empty()) {
+            buffer = m_free_buffers.back();
+            m_free_buffers.pop_back();
+        }
+    }
+
+    if (buffer == CAPTURE_QUEUE_SIZE) {
+        // The writer is behind and the queue is full
+        m_dropped++;
+    } else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pack_buffers[m_ring_head]);
+        const void * data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+        if (data != NULL)
+            memcpy(&m_pixels[buffer][0], data, size);
+
+        bool mapped = data != NULL && glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_TRUE;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (mapped) {
+            CapturedFrame frame;
+
+            frame.frame = readback.frame;
+            frame.buffer = buffer;
+            frame.issued = readback.issued;
+            m_queue.push_back(frame);
+            m_queue_ready.notify_one();
+        } else {
+            m_free_buffers.push_back(buffer);
+            m_dropped++;
+        }
+    }
+
+    m_ring_head = (m_ring_head + 1) % CAPTURE_RING_SIZE;
+    m_ring_count--;
+}
+
+void FrameCapture::WriterThread(void)
+{
+    std::vector<unsigned char> row((size_t)m_width * 3);
+
+    for (;;) {
+        CapturedFrame frame;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while (m_queue.empty() && !m_quit)
+                m_queue_ready.wait(lock);
+
+            // Only quit once the queue has drained
+            if (m_queue.empty())
+                break;
+
+            frame = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        bool ok = WriteFrame(frame, row);
+        double latency = std::chrono::duration<double, std::milli>(clock::now() - frame.issued).count();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_free_buffers.push_back(frame.buffer);
+        if (ok) {
+            m_written++;
+            m_write_latency_ms += latency;
+        } else {
+            m_write_failures++;
+        }
+    }
+}
+
+// Writes a binary PPM. GL rows run bottom to top, so they are flipped, and
+// the BGRA pixels lose their alpha.
+bool FrameCapture::WriteFrame(const CapturedFrame & frame, std::vector<unsigned char> & row)
+{
+    const std::vector<unsigned char> & pixels = m_pixels[frame.buffer];
+    char filename[1024];
+    int x, y;
+
+    snprintf(filename, sizeof(filename), "%s%05u.ppm", m_prefix.c_str(), frame.frame);
+
+    FILE * f = fopen(filename, "wb");
+    if (f == NULL)
+        return false;
+
+    fprintf(f, "P6\n%d %d\n255\n", m_width, m_height);
+    for (y = m_height - 1; y >= 0; y--) {
+        const unsigned char * src = &pixels[(size_t)y * m_width * 4];
+
+        for (x = 0; x < m_width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 2];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 0];
+        }
+        fwrite(&row[0], 1, row.size(), f);
+    }
+
+    bool ok = ferror(f) == 0;
+    if (fclose(f) != 0)
+        ok = false;
+
+    return ok;
+}
+
+// Latencies are from the readback being issued: to the buffer being mapped
+// (in frames and ms) and to the file being written. The overhead is the
+// main thread's time in CaptureFrame against the whole frame time; any GPU
+// cost of the readback shows up in the frame time itself.
+void FrameCapture::Report(void)
+{
+    unsigned int written, write_failures;
+    double write_latency_ms;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        written = m_written;
+        write_failures = m_write_failures;
+        write_latency_ms = m_write_latency_ms;
+    }
+
+    printf("Capture: %u frames, %u written, %u dropped, %u failed; "
+           "readback latency %.1f frames (%.1f ms), write latency %.1f ms; "
+           "frame time %.2f ms, capture overhead %.1f%%\n",
+           m_frame, written, m_dropped, write_failures,
+           m_retired ? double(m_readback_latency_frames) / m_retired : 0.0,
+           m_retired ? m_readback_latency_ms / m_retired : 0.0,
+           written ? write_latency_ms / written : 0.0,
+           m_frame > 1 ? m_frame_ms / (m_frame - 1) : 0.0,
+           m_frame_ms > 0.0 ? m_capture_ms * 100.0 / m_frame_ms : 0.0);
+}
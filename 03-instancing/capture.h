@@ -0,0 +1,110 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+// Records rendered frames to disk without stalling the GL pipeline. Each
+// frame is read back into one of a ring of pixel pack buffers and fenced;
+// the buffer is only mapped once its fence has signaled (normally a frame
+// or two later), and a writer thread does the file I/O.
+#include <GL/glew.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Number of readbacks that can be in flight on the GPU. When all of them
+// are still pending the new frame is dropped rather than waited for.
+#define CAPTURE_RING_SIZE           3
+
+// Number of frames that can be waiting for (or being written by) the writer
+// thread. Frames are dropped when the writer falls this far behind.
+#define CAPTURE_QUEUE_SIZE          8
+
+// Stop() waits for outstanding readbacks in steps of CAPTURE_WAIT_TIMEOUT
+// nanoseconds, up to CAPTURE_STOP_WAITS times, then drops whatever is left
+// so that a lost context or hung GPU can't block shutdown
+#define CAPTURE_WAIT_TIMEOUT        100000000
+#define CAPTURE_STOP_WAITS          20
+
+class FrameCapture
+{
+public:
+    FrameCapture(void);
+    ~FrameCapture(void);
+
+    // Frames are written as <prefix>NNNNN.ppm, numbered from the first frame
+    // captured after Start
+    bool Start(const char * prefix, int width, int height);
+    void Stop(void);
+
+    // Call once per frame, after rendering and before the buffer swap
+    void CaptureFrame(void);
+
+    bool IsCapturing(void) const
+    {
+        return m_capturing;
+    }
+
+protected:
+    typedef std::chrono::steady_clock clock;
+
+    struct Readback
+    {
+        GLsync fence;
+        unsigned int frame;
+        clock::time_point issued;
+    };
+
+    struct CapturedFrame
+    {
+        unsigned int frame;
+        unsigned int buffer;
+        clock::time_point issued;
+    };
+
+    void Retire(void);
+    void WriterThread(void);
+    bool WriteFrame(const CapturedFrame & frame, std::vector<unsigned char> & row);
+    void Report(void);
+
+    bool m_capturing;
+    std::string m_prefix;
+    int m_width;
+    int m_height;
+
+    // Readbacks in flight, oldest at m_ring_head
+    GLuint m_pack_buffers[CAPTURE_RING_SIZE];
+    Readback m_ring[CAPTURE_RING_SIZE];
+    unsigned int m_ring_head;
+    unsigned int m_ring_count;
+    unsigned int m_frame;
+
+    // Writer thread state. The queue, free list and writer counters are
+    // guarded by m_mutex; a pixel buffer belongs to whoever took it off the
+    // free list or the queue.
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_queue_ready;
+    std::deque<CapturedFrame> m_queue;
+    std::vector<unsigned int> m_free_buffers;
+    std::vector<unsigned char> m_pixels[CAPTURE_QUEUE_SIZE];
+    bool m_quit;
+    unsigned int m_written;
+    unsigned int m_write_failures;
+    double m_write_latency_ms;
+
+    // Main thread counters
+    unsigned int m_retired;
+    unsigned int m_dropped;
+    unsigned long long m_readback_latency_frames;
+    double m_readback_latency_ms;
+    double m_capture_ms;
+    double m_frame_ms;
+    clock::time_point m_last_frame;
+    clock::time_point m_last_report;
+};
+
+#endif /* __CAPTURE_H__ */
@@ -0,0 +1,41 @@
+#version 410
+
+uniform mat4 model_matrix[4];
+uniform mat4 projection_matrix;
+
+// Keyframe animation: frames are fetched from a texture buffer holding a
+// (position, normal) texel pair per vertex, per frame
+uniform bool animated;
+uniform int frame_vertices;
+uniform ivec2 anim_clips[4];
+uniform samplerBuffer frames;
+
+layout (location = 0) in vec4 position;
+
+layout (location = 3) in vec4 instance_weights;
+layout (location = 5) in vec3 instance_anim;
+
+invariant gl_Position;
+
+void main(void)
+{
+    int n;
+    mat4 m = mat4(0.0);
+    vec4 pos = position;
+    if (animated)
+    {
+        ivec2 clip = anim_clips[int(instance_anim.x)];
+        int frame = int(instance_anim.y);
+        int f0 = clip.x + frame % clip.y;
+        int f1 = clip.x + (frame + 1) % clip.y;
+        pos = mix(texelFetch(frames, (f0 * frame_vertices + gl_VertexID) * 2),
+                  texelFetch(frames, (f1 * frame_vertices + gl_VertexID) * 2),
+                  instance_anim.z);
+    }
+    vec4 weights = normalize(instance_weights);
+    for (n = 0; n < 4; n++)
+    {
+        m += (model_matrix[n] * weights[n]);
+    }
+    gl_Position = projection_matrix * (m * pos);
+}
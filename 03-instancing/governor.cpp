@@ -0,0 +1,158 @@
+#include "governor.h"
+
+#include <math.h>
+#include <stdio.h>
+
+// Frames within this fraction of the target count as on target
+#define GOVERNOR_ON_TARGET          0.1f
+
+static inline float clamp(float x, float a, float b)
+{
+    return x < a ? a : (x > b ? b : x);
+}
+
+void GetDefaultGovernorSettings(GOVERNOR_SETTINGS * settings)
+{
+    settings->target_ms = 8.3f;
+    settings->kp = 0.3f;
+    settings->ki = 0.05f;
+    settings->kd = 0.1f;
+    settings->smoothing = 0.2f;
+    settings->hysteresis = 0.05f;
+    settings->min_cutoff = 0.25f;
+    settings->min_instances = 1;
+    settings->max_instances = 1;
+}
+
+FrameGovernor::FrameGovernor(void)
+{
+    GetDefaultGovernorSettings(&m_settings);
+    Reset();
+}
+
+void FrameGovernor::Configure(const GOVERNOR_SETTINGS & settings)
+{
+    m_settings = settings;
+    if (m_settings.max_instances < m_settings.min_instances)
+        m_settings.max_instances = m_settings.min_instances;
+}
+
+void FrameGovernor::Reset(void)
+{
+    // Start at full quality and let the controller back off from there
+    m_level = 1.0f;
+    m_integral = 1.0f;
+    m_frame_ms = -1.0f;
+    m_gpu_ms = -1.0f;
+    m_adjusting = false;
+
+    m_frames = 0;
+    m_frames_on_target = 0;
+    m_sum_cpu_ms = 0.0;
+    m_sum_gpu_ms = 0.0;
+    m_gpu_samples = 0;
+    m_sum_abs_error = 0.0;
+    m_sum_instances = 0.0;
+    m_sum_cutoff = 0.0;
+}
+
+void FrameGovernor::Update(float cpu_ms, float gpu_ms)
+{
+    const float target = m_settings.target_ms;
+
+    if (gpu_ms >= 0.0f) {
+        m_gpu_ms = gpu_ms;
+        m_sum_gpu_ms += gpu_ms;
+        m_gpu_samples++;
+    }
+
+    // Whichever side is slower sets the frame time
+    float sample = cpu_ms > m_gpu_ms ? cpu_ms : m_gpu_ms;
+    float last_frame_ms = m_frame_ms;
+
+    if (m_frame_ms < 0.0f)
+        m_frame_ms = sample;
+    else
+        m_frame_ms += m_settings.smoothing * (sample - m_frame_ms);
+
+    if (last_frame_ms < 0.0f)
+        last_frame_ms = m_frame_ms;
+
+    // Positive error is headroom, negative is over budget
+    float error = (target - m_frame_ms) / target;
+
+    // Schmitt trigger around zero error so that noise near the target
+    // doesn't keep the knobs moving
+    if (!m_adjusting && fabsf(error) > m_settings.hysteresis)
+        m_adjusting = true;
+    else if (m_adjusting && fabsf(error) < m_settings.hysteresis * 0.5f)
+        m_adjusting = false;
+
+    if (m_adjusting) {
+        // The integral term is clamped to the output range so it can't wind
+        // up while a knob is pinned, and the derivative is taken on the
+        // measurement so that starting to adjust doesn't kick the output
+        m_integral = clamp(m_integral + m_settings.ki * error, 0.0f, 1.0f);
+
+        float derivative = (last_frame_ms - m_frame_ms) / target;
+
+        m_level = clamp(m_settings.kp * error + m_integral + m_settings.kd * derivative, 0.0f, 1.0f);
+    } else {
+        // Hold the current setting; keeping the integral there means
+        // proportional action picks up smoothly when it's next needed
+        m_integral = m_level;
+    }
+
+    m_frames++;
+    if (fabsf(sample - target) <= target * GOVERNOR_ON_TARGET)
+        m_frames_on_target++;
+    m_sum_cpu_ms += cpu_ms;
+    m_sum_abs_error += fabsf(sample - target) / target;
+    m_sum_instances += GetInstanceCap();
+    m_sum_cutoff += GetFarCutoff();
+}
+
+unsigned int FrameGovernor::GetInstanceCap(void) const
+{
+    const unsigned int range = m_settings.max_instances - m_settings.min_instances;
+
+    // The cap only comes down once the cutoff is all the way in
+    if (m_level >= 0.5f)
+        return m_settings.max_instances;
+
+    return m_settings.min_instances + (unsigned int)(range * m_level * 2.0f + 0.5f);
+}
+
+float FrameGovernor::GetFarCutoff(void) const
+{
+    if (m_level <= 0.5f)
+        return m_settings.min_cutoff;
+
+    return m_settings.min_cutoff + (1.0f - m_settings.min_cutoff) * (m_level - 0.5f) * 2.0f;
+}
+
+void FrameGovernor::PrintTelemetry(void)
+{
+    if (m_frames == 0)
+        return;
+
+    printf("Governor: target %.1f ms, cpu %.2f ms, gpu %.2f ms, on target %.0f%% of frames, mean error %.1f%%, "
+           "level %.2f, instances %.0f, cutoff %.2f\n",
+           m_settings.target_ms,
+           m_sum_cpu_ms / m_frames,
+           m_gpu_samples ? m_sum_gpu_ms / m_gpu_samples : 0.0,
+           100.0 * m_frames_on_target / m_frames,
+           100.0 * m_sum_abs_error / m_frames,
+           m_level,
+           m_sum_instances / m_frames,
+           m_sum_cutoff / m_frames);
+
+    m_frames = 0;
+    m_frames_on_target = 0;
+    m_sum_cpu_ms = 0.0;
+    m_sum_gpu_ms = 0.0;
+    m_gpu_samples = 0;
+    m_sum_abs_error = 0.0;
+    m_sum_instances = 0.0;
+    m_sum_cutoff = 0.0;
+}
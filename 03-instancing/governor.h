@@ -0,0 +1,81 @@
+#ifndef __GOVERNOR_H__
+#define __GOVERNOR_H__
+
+// Frame-time governor. Each frame it is fed the measured CPU and GPU times
+// and steers a single quality level in [0, 1] with a PID controller so that
+// the slower of the two stays on target. The level is then spent on two
+// knobs: the far cutoff goes first (distant instances are the least
+// noticeable), then the cap on the number of instances drawn.
+//
+// Nothing in here touches GL; measuring the times is up to the caller.
+
+typedef struct GOVERNOR_SETTINGS_t
+{
+    float target_ms;                // frame time goal
+    float kp;                       // PID gains, on the error as a fraction
+    float ki;                       // of the target (so +0.1 is 10% headroom)
+    float kd;
+    float smoothing;                // weight of each new sample in the moving average
+    float hysteresis;               // error the controller starts reacting at, as a
+                                    // fraction of the target; it settles at half that
+    float min_cutoff;               // nearest far cutoff, as a fraction of the depth range
+    unsigned int min_instances;
+    unsigned int max_instances;
+} GOVERNOR_SETTINGS;
+
+// 120 Hz target and gains that settle within a second or so at 60 frames/s
+void GetDefaultGovernorSettings(GOVERNOR_SETTINGS * settings);
+
+class FrameGovernor
+{
+public:
+    FrameGovernor(void);
+
+    void Configure(const GOVERNOR_SETTINGS & settings);
+    void Reset(void);
+
+    // Feeds one frame's timings. A negative gpu_ms means no GPU time is
+    // available for this frame (timer queries lag a few frames behind).
+    void Update(float cpu_ms, float gpu_ms);
+
+    unsigned int GetInstanceCap(void) const;
+
+    // Far cutoff as a fraction of the instances' depth range this frame:
+    // 1 draws everything, smaller values drop the farthest instances
+    float GetFarCutoff(void) const;
+
+    float GetLevel(void) const
+    {
+        return m_level;
+    }
+
+    const GOVERNOR_SETTINGS & GetSettings(void) const
+    {
+        return m_settings;
+    }
+
+    // Prints the averages since the last call: timings, how often the frame
+    // time was within 10% of the target, and where the knobs sat
+    void PrintTelemetry(void);
+
+protected:
+    GOVERNOR_SETTINGS m_settings;
+
+    float m_level;
+    float m_frame_ms;               // smoothed
+    float m_gpu_ms;                 // latest GPU sample, held until the next one
+    float m_integral;
+    bool m_adjusting;
+
+    // Telemetry since the last PrintTelemetry()
+    unsigned int m_frames;
+    unsigned int m_frames_on_target;
+    double m_sum_cpu_ms;
+    double m_sum_gpu_ms;
+    unsigned int m_gpu_samples;
+    double m_sum_abs_error;
+    double m_sum_instances;
+    double m_sum_cutoff;
+};
+
+#endif /* __GOVERNOR_H__ */
@@ -0,0 +1,143 @@
+#include "instances.h"
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+
+void ComputeInstanceDepths(const glm::mat4 & projection_matrix,
+                           const glm::mat4 model_matrix[4],
+                           const glm::vec4 * weights,
+                           unsigned int count,
+                           float * depth)
+{
+    // Only the w row of the projection matters and the instance origin is
+    // (0, 0, 0, 1), so each matrix reduces to a single dot product with its
+    // translation column.
+    const glm::vec4 w_row(projection_matrix[0][3], projection_matrix[1][3], projection_matrix[2][3], projection_matrix[3][3]);
+    float origin_w[4];
+    unsigned int i;
+    int n;
+
+    for (n = 0; n < 4; n++)
+        origin_w[n] = glm::dot(w_row, model_matrix[n][3]);
+
+    for (i = 0; i < count; i++)
+    {
+        glm::vec4 w = glm::normalize(weights[i]);
+
+        depth[i] = w[0] * origin_w[0] + w[1] * origin_w[1] + w[2] * origin_w[2] + w[3] * origin_w[3];
+    }
+}
+
+// Quantizes a depth to its bucket. The float is clamped before the cast,
+// which would be undefined out of range; NaN fails both tests and lands in
+// the last bucket along with anything too far away.
+static inline unsigned int DepthKey(float depth, float min_depth, float key_scale)
+{
+    float key = (depth - min_depth) * key_scale;
+
+    if (key < 0.0f)
+        return 0;
+    if (key < float(INSTANCE_DEPTH_BUCKETS - 1))
+        return (unsigned int)key;
+
+    return INSTANCE_DEPTH_BUCKETS - 1;
+}
+
+void SortInstancesFrontToBack(const float * depth,
+                              unsigned int count,
+                              unsigned int * order,
+                              unsigned int * bucket_end)
+{
+    unsigned int bucket_start[INSTANCE_DEPTH_BUCKETS];
+    unsigned int i;
+
+    if (count == 0)
+    {
+        if (bucket_end != NULL)
+        {
+            for (i = 0; i < INSTANCE_DEPTH_BUCKETS; i++)
+                bucket_end[i] = 0;
+        }
+        return;
+    }
+
+    float min_depth = FLT_MAX;
+    float max_depth = -FLT_MAX;
+
+    // Non-finite depths (an instance on the eye plane, or a degenerate
+    // matrix) are left out of the range so that they don't flatten it
+    for (i = 0; i < count; i++)
+    {
+        if (!(depth[i] >= -FLT_MAX && depth[i] <= FLT_MAX))
+            continue;
+        if (depth[i] < min_depth)
+            min_depth = depth[i];
+        if (depth[i] > max_depth)
+            max_depth = depth[i];
+    }
+
+    // Keys are quantized over this frame's depth range rather than the
+    // whole frustum so that the buckets aren't wasted on empty space. A
+    // range too small to divide by puts everything in one bucket.
+    float range = max_depth - min_depth;
+    float key_scale = range > 0.0f ? float(INSTANCE_DEPTH_BUCKETS - 1) / range : 0.0f;
+
+    if (!(key_scale <= FLT_MAX))
+        key_scale = 0.0f;
+
+    for (i = 0; i < INSTANCE_DEPTH_BUCKETS; i++)
+        bucket_start[i] = 0;
+
+    for (i = 0; i < count; i++)
+        bucket_start[DepthKey(depth[i], min_depth, key_scale)]++;
+
+    unsigned int offset = 0;
+
+    for (i = 0; i < INSTANCE_DEPTH_BUCKETS; i++)
+    {
+        unsigned int bucket_size = bucket_start[i];
+        bucket_start[i] = offset;
+        offset += bucket_size;
+    }
+
+    for (i = 0; i < count; i++)
+        order[bucket_start[DepthKey(depth[i], min_depth, key_scale)]++] = i;
+
+    // Each start has been advanced past its bucket's last instance
+    if (bucket_end != NULL)
+    {
+        for (i = 0; i < INSTANCE_DEPTH_BUCKETS; i++)
+            bucket_end[i] = bucket_start[i];
+    }
+}
+
+unsigned int CountInstancesWithinDepth(const unsigned int * bucket_end,
+                                       float cutoff)
+{
+    if (cutoff <= 0.0f)
+        return bucket_end[0];
+    if (cutoff >= 1.0f)
+        return bucket_end[INSTANCE_DEPTH_BUCKETS - 1];
+
+    return bucket_end[(unsigned int)(cutoff * float(INSTANCE_DEPTH_BUCKETS - 1))];
+}
+
+void ComputeInstanceAnimation(const ANIMATION_CLIP * clips,
+                              const unsigned int * clip_index,
+                              const float * time_offset,
+                              unsigned int count,
+                              float time,
+                              glm::vec3 * anim)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+    {
+        const ANIMATION_CLIP & clip = clips[clip_index[i]];
+        float position = fmodf((time + time_offset[i]) * clip.frames_per_second, float(clip.frame_count));
+        float frame = floorf(position);
+
+        anim[i] = glm::vec3(float(clip_index[i]), frame, position - frame);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef __INSTANCES_H__
+#define __INSTANCES_H__
+
+// CPU-side helpers for the instance streams. Nothing in here touches GL so
+// the same code can be shared with tools that don't have a context.
+#include <glm/glm.hpp>
+
+// Number of depth buckets used by SortInstancesFrontToBack(). The ordering is
+// only meant to be good enough to get early depth rejection going, so a
+// single counting pass over a coarse key is all we do.
+#define INSTANCE_DEPTH_BUCKETS      256
+
+// Maximum number of animation clips, matching anim_clips[] in the shaders
+#define MAX_ANIMATION_CLIPS         4
+
+typedef struct ANIMATION_CLIP_t
+{
+    unsigned int first_frame;
+    unsigned int frame_count;
+    float frames_per_second;
+} ANIMATION_CLIP;
+
+// Computes the view depth (clip-space w) of the origin of each instance as
+// placed by render.vs.glsl - that is, the model matrix is the blend of the
+// four matrices in model_matrix by the normalized instance weights.
+void ComputeInstanceDepths(const glm::mat4 & projection_matrix,
+                           const glm::mat4 model_matrix[4],
+                           const glm::vec4 * weights,
+                           unsigned int count,
+                           float * depth);
+
+// Writes into order the instance indices sorted near-to-far, bucketed by
+// depth. The sort is stable, so instances sharing a bucket keep their
+// original relative order. If bucket_end isn't NULL it receives
+// INSTANCE_DEPTH_BUCKETS entries, each the position in order just past the
+// last instance of that bucket.
+void SortInstancesFrontToBack(const float * depth,
+                              unsigned int count,
+                              unsigned int * order,
+                              unsigned int * bucket_end);
+
+// Returns how many instances at the front of the order lie within cutoff
+// (0 to 1) of this frame's depth range, given the bucket_end written by
+// SortInstancesFrontToBack(). The result is always a whole prefix of the
+// order and, as long as some instance has a finite depth, never less than
+// one. Instances with NaN depths sort to the far end, as do infinitely
+// far ones.
+unsigned int CountInstancesWithinDepth(const unsigned int * bucket_end,
+                                       float cutoff);
+
+// Fills in the instance_anim stream consumed by the shaders at the given time
+// (in seconds): x is the clip index, y the frame within the clip and z the
+// phase towards the next frame. time_offset staggers instances playing the
+// same clip.
+void ComputeInstanceAnimation(const ANIMATION_CLIP * clips,
+                              const unsigned int * clip_index,
+                              const float * time_offset,
+                              unsigned int count,
+                              float time,
+                              glm::vec3 * anim);
+
+#endif /* __INSTANCES_H__ */
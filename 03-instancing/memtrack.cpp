@@ -0,0 +1,235 @@
+#include "memtrack.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+
+struct GLObject
+{
+    MEMORY_CATEGORY category;
+    size_t bytes;
+};
+
+static std::mutex s_mutex;
+static MEMORY_USAGE s_usage[MEMORY_CATEGORY_COUNT];
+static std::map<unsigned int, GLObject> s_buffers;
+static std::map<unsigned int, GLObject> s_textures;
+
+static const char * s_category_names[MEMORY_CATEGORY_COUNT] =
+{
+    "cpu file",
+    "cpu mesh",
+    "cpu staging",
+    "gpu vertex",
+    "gpu index",
+    "gpu instance",
+    "gpu texture",
+    "gpu staging"
+};
+
+// Both of these expect s_mutex to be held
+static void Add(MEMORY_CATEGORY category, size_t bytes)
+{
+    MEMORY_USAGE & usage = s_usage[category];
+
+    usage.bytes += bytes;
+    if (usage.bytes > usage.peak_bytes)
+        usage.peak_bytes = usage.bytes;
+    usage.allocations++;
+    usage.total_allocations++;
+}
+
+static void Remove(MEMORY_CATEGORY category, size_t bytes)
+{
+    MEMORY_USAGE & usage = s_usage[category];
+
+    usage.bytes = usage.bytes > bytes ? usage.bytes - bytes : 0;
+    if (usage.allocations)
+        usage.allocations--;
+}
+
+static void Track(std::map<unsigned int, GLObject> & objects, unsigned int name, MEMORY_CATEGORY category, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::map<unsigned int, GLObject>::iterator it = objects.find(name);
+
+    if (it != objects.end()) {
+        Remove(it->second.category, it->second.bytes);
+    } else {
+        it = objects.insert(std::make_pair(name, GLObject())).first;
+    }
+
+    it->second.category = category;
+    it->second.bytes = bytes;
+    Add(category, bytes);
+}
+
+static void Untrack(std::map<unsigned int, GLObject> & objects, unsigned int name)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::map<unsigned int, GLObject>::iterator it = objects.find(name);
+
+    if (it == objects.end())
+        return;
+
+    Remove(it->second.category, it->second.bytes);
+    objects.erase(it);
+}
+
+const char * GetMemoryCategoryName(MEMORY_CATEGORY category)
+{
+    return category < MEMORY_CATEGORY_COUNT ? s_category_names[category] : "unknown";
+}
+
+void MemoryAllocated(MEMORY_CATEGORY category, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Add(category, bytes);
+}
+
+void MemoryFreed(MEMORY_CATEGORY category, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    Remove(category, bytes);
+}
+
+void TrackGLBuffer(unsigned int buffer, MEMORY_CATEGORY category, size_t bytes)
+{
+    if (buffer != 0)
+        Track(s_buffers, buffer, category, bytes);
+}
+
+void UntrackGLBuffer(unsigned int buffer)
+{
+    if (buffer != 0)
+        Untrack(s_buffers, buffer);
+}
+
+void TrackGLTexture(unsigned int texture, MEMORY_CATEGORY category, size_t bytes)
+{
+    if (texture != 0)
+        Track(s_textures, texture, category, bytes);
+}
+
+void UntrackGLTexture(unsigned int texture)
+{
+    if (texture != 0)
+        Untrack(s_textures, texture);
+}
+
+void GetMemoryUsage(MEMORY_CATEGORY category, MEMORY_USAGE * usage)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    *usage = s_usage[category];
+}
+
+unsigned long long GetCPUMemoryBytes(void)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    return s_usage[MEMORY_CPU_FILE].bytes + s_usage[MEMORY_CPU_MESH].bytes + s_usage[MEMORY_CPU_STAGING].bytes;
+}
+
+unsigned long long GetGPUMemoryBytes(void)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    unsigned long long bytes = 0;
+    int category;
+
+    for (category = MEMORY_GPU_VERTEX; category < MEMORY_CATEGORY_COUNT; category++)
+        bytes += s_usage[category].bytes;
+
+    return bytes;
+}
+
+void DumpMemoryUsage(FILE * f)
+{
+    MEMORY_USAGE usage[MEMORY_CATEGORY_COUNT];
+    unsigned long long cpu = 0, gpu = 0;
+    int category;
+
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (category = 0; category < MEMORY_CATEGORY_COUNT; category++)
+            usage[category] = s_usage[category];
+    }
+
+    fprintf(f, "%-14s %12s %12s %8s %8s\n", "Memory", "bytes", "peak", "live", "total");
+    for (category = 0; category < MEMORY_CATEGORY_COUNT; category++) {
+        fprintf(f, "%-14s %12llu %12llu %8llu %8llu\n",
+                s_category_names[category], usage[category].bytes, usage[category].peak_bytes,
+                usage[category].allocations, usage[category].total_allocations);
+
+        if (category < MEMORY_GPU_VERTEX)
+            cpu += usage[category].bytes;
+        else
+            gpu += usage[category].bytes;
+    }
+    fprintf(f, "%-14s %12llu\n%-14s %12llu\n", "cpu total", cpu, "gpu total", gpu);
+}
+
+MemoryArena::MemoryArena(MEMORY_CATEGORY category, size_t block_size)
+    : m_category(category),
+      m_block_size(block_size),
+      m_bytes(0),
+      m_blocks(NULL)
+{
+
+}
+
+MemoryArena::~MemoryArena(void)
+{
+    Release();
+}
+
+void * MemoryArena::Allocate(size_t size, size_t alignment)
+{
+    if (size == 0)
+        return NULL;
+
+    Block * block = m_blocks;
+    uintptr_t address = 0;
+
+    if (block != NULL) {
+        address = (uintptr_t)(block + 1) + block->used;
+        address = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    // Start a new block when the current one can't fit the allocation.
+    // Oversized requests get a block of their own size.
+    if (block == NULL || address + size > (uintptr_t)(block + 1) + block->size) {
+        size_t block_size = size + alignment > m_block_size ? size + alignment : m_block_size;
+
+        block = (Block *)malloc(sizeof(Block) + block_size);
+        if (block == NULL)
+            return NULL;
+
+        block->next = m_blocks;
+        block->size = block_size;
+        block->used = 0;
+        m_blocks = block;
+        m_bytes += sizeof(Block) + block_size;
+        MemoryAllocated(m_category, sizeof(Block) + block_size);
+
+        address = (uintptr_t)(block + 1);
+        address = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+
+    block->used = address + size - (uintptr_t)(block + 1);
+
+    return (void *)address;
+}
+
+void MemoryArena::Release(void)
+{
+    while (m_blocks != NULL) {
+        Block * next = m_blocks->next;
+
+        MemoryFreed(m_category, sizeof(Block) + m_blocks->size);
+        free(m_blocks);
+        m_blocks = next;
+    }
+
+    m_bytes = 0;
+}
@@ -0,0 +1,97 @@
+#ifndef __MEMTRACK_H__
+#define __MEMTRACK_H__
+
+// Memory accounting. CPU allocations are tagged with a category when they
+// are made; GL buffers and textures are registered by name with their size,
+// so re-specifying a buffer just updates its entry. Nothing in here calls
+// GL, which is left to the code that owns the objects.
+#include <stddef.h>
+#include <stdio.h>
+
+typedef enum MEMORY_CATEGORY_t
+{
+    MEMORY_CPU_FILE,            // file contents while loading
+    MEMORY_CPU_MESH,            // mesh metadata (headers, frames, materials)
+    MEMORY_CPU_STAGING,         // upload and readback copies
+    MEMORY_GPU_VERTEX,          // vertex attribute buffers
+    MEMORY_GPU_INDEX,           // index buffers
+    MEMORY_GPU_INSTANCE,        // per-instance attribute streams
+    MEMORY_GPU_TEXTURE,         // textures, including texture buffer storage
+    MEMORY_GPU_STAGING,         // pixel pack/unpack buffers
+    MEMORY_CATEGORY_COUNT
+} MEMORY_CATEGORY;
+
+typedef struct MEMORY_USAGE_t
+{
+    unsigned long long bytes;           // currently allocated
+    unsigned long long peak_bytes;
+    unsigned long long allocations;     // live allocations or GL objects
+    unsigned long long total_allocations;
+} MEMORY_USAGE;
+
+const char * GetMemoryCategoryName(MEMORY_CATEGORY category);
+
+// CPU allocations. These only count; the caller does the allocating.
+void MemoryAllocated(MEMORY_CATEGORY category, size_t bytes);
+void MemoryFreed(MEMORY_CATEGORY category, size_t bytes);
+
+// GL objects. Registering a name again replaces its size and category, and
+// unregistering a name that was never registered is ignored (so that it is
+// safe on the zero name too).
+void TrackGLBuffer(unsigned int buffer, MEMORY_CATEGORY category, size_t bytes);
+void UntrackGLBuffer(unsigned int buffer);
+void TrackGLTexture(unsigned int texture, MEMORY_CATEGORY category, size_t bytes);
+void UntrackGLTexture(unsigned int texture);
+
+void GetMemoryUsage(MEMORY_CATEGORY category, MEMORY_USAGE * usage);
+
+// Sum over the CPU or the GPU categories
+unsigned long long GetCPUMemoryBytes(void);
+unsigned long long GetGPUMemoryBytes(void);
+
+// Prints a table of every category
+void DumpMemoryUsage(FILE * f);
+
+// Bump allocator for data that lives and dies together, like the metadata
+// of a mesh. Memory comes from a list of blocks, is never freed
+// individually and is not constructed, so it is only meant for plain
+// structures. Release() frees everything at once.
+class MemoryArena
+{
+public:
+    MemoryArena(MEMORY_CATEGORY category, size_t block_size = 4096);
+    ~MemoryArena(void);
+
+    void * Allocate(size_t size, size_t alignment = 16);
+    void Release(void);
+
+    template <typename T>
+    T * AllocateArray(size_t count)
+    {
+        return static_cast<T *>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    size_t GetBytes(void) const
+    {
+        return m_bytes;
+    }
+
+protected:
+    struct Block
+    {
+        Block * next;
+        size_t size;
+        size_t used;
+    };
+
+    MEMORY_CATEGORY m_category;
+    size_t m_block_size;
+    size_t m_bytes;
+    Block * m_blocks;
+
+private:
+    MemoryArena(const MemoryArena &);
+    MemoryArena & operator=(const MemoryArena &);
+};
+
+#endif /* __MEMTRACK_H__ */
@@ -3,26 +3,50 @@
 uniform mat4 model_matrix[4];
 uniform mat4 projection_matrix;
 
+// Keyframe animation: frames are fetched from a texture buffer holding a
+// (position, normal) texel pair per vertex, per frame
+uniform bool animated;
+uniform int frame_vertices;
+uniform ivec2 anim_clips[4];
+uniform samplerBuffer frames;
+
 layout (location = 0) in vec4 position;
 layout (location = 1) in vec3 normal;
 
 layout (location = 3) in vec4 instance_weights;
 layout (location = 4) in vec4 instance_color;
+layout (location = 5) in vec3 instance_anim;
 
 out vec3 vs_fs_normal;
 out vec4 vs_fs_color;
 
+// Must match depth.vs.glsl exactly so the depth pre-pass lines up
+invariant gl_Position;
+
 void main(void)
 {
     int n;
     mat4 m = mat4(0.0);
     vec4 pos = position;
+    vec3 nrm = normal;
+    if (animated)
+    {
+        // instance_anim is (clip, frame within clip, phase towards next frame)
+        ivec2 clip = anim_clips[int(instance_anim.x)];
+        int frame = int(instance_anim.y);
+        int f0 = clip.x + frame % clip.y;
+        int f1 = clip.x + (frame + 1) % clip.y;
+        int t0 = (f0 * frame_vertices + gl_VertexID) * 2;
+        int t1 = (f1 * frame_vertices + gl_VertexID) * 2;
+        pos = mix(texelFetch(frames, t0), texelFetch(frames, t1), instance_anim.z);
+        nrm = mix(texelFetch(frames, t0 + 1).xyz, texelFetch(frames, t1 + 1).xyz, instance_anim.z);
+    }
     vec4 weights = normalize(instance_weights);
     for (n = 0; n < 4; n++)
     {
         m += (model_matrix[n] * weights[n]);
     }
-    vs_fs_normal = normalize((m * vec4(normal, 0.0)).xyz);
+    vs_fs_normal = normalize((m * vec4(nrm, 0.0)).xyz);
     vs_fs_color = instance_color;
     gl_Position = projection_matrix * (m * pos);
 }
@@ -0,0 +1,91 @@
+#include "scene.h"
+
+#include <math.h>
+#include <string.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+float SceneTime(unsigned int app_time)
+{
+    return float(app_time & 0x3FFFF) / float(0x3FFFF);
+}
+
+void GenerateInstanceColors(glm::vec4 * colors, unsigned int count)
+{
+    unsigned int n;
+
+    for (n = 0; n < count; n++)
+    {
+        float a = float(n) / 4.0f;
+        float b = float(n) / 5.0f;
+        float c = float(n) / 6.0f;
+
+        colors[n][0] = 0.5f * (sinf(a + 1.0f) + 1.0f);
+        colors[n][1] = 0.5f * (sinf(b + 2.0f) + 1.0f);
+        colors[n][2] = 0.5f * (sinf(c + 3.0f) + 1.0f);
+        colors[n][3] = 1.0f;
+    }
+}
+
+void GenerateInstanceWeights(float t, glm::vec4 * weights, unsigned int count)
+{
+    unsigned int n;
+
+    for (n = 0; n < count; n++)
+    {
+        float a = float(n) / 4.0f;
+        float b = float(n) / 5.0f;
+        float c = float(n) / 6.0f;
+
+        weights[n][0] = 0.5f * (sinf(t * 6.28318531f * 8.0f + a) + 1.0f);
+        weights[n][1] = 0.5f * (sinf(t * 6.28318531f * 26.0f + b) + 1.0f);
+        weights[n][2] = 0.5f * (sinf(t * 6.28318531f * 21.0f + c) + 1.0f);
+        weights[n][3] = 0.5f * (sinf(t * 6.28318531f * 13.0f + a + b) + 1.0f);
+    }
+}
+
+void GenerateModelMatrices(float t, glm::mat4 model_matrix[4])
+{
+    int n;
+
+    for (n = 0; n < 4; n++)
+    {
+        model_matrix[n] = (glm::scale(glm::mat4(), glm::vec3(5.0f, 5.0f, 5.0f)) *
+                           glm::rotate(glm::mat4(), glm::radians(t * 360.0f * 40.0f + float(n + 1) * 29.0f), glm::vec3(0.0f, 1.0f, 0.0f)) *
+                           glm::rotate(glm::mat4(), glm::radians(t * 360.0f * 20.0f + float(n + 1) * 35.0f), glm::vec3(0.0f, 0.0f, 1.0f)) *
+                           glm::rotate(glm::mat4(), glm::radians(t * 360.0f * 30.0f + float(n + 1) * 67.0f), glm::vec3(0.0f, 1.0f, 0.0f)) *
+                           glm::translate(glm::mat4(), glm::vec3((float)n * 10.0f - 15.0f, 0.0f, 0.0f)) *
+                           glm::scale(glm::mat4(), glm::vec3(0.01f, 0.01f, 0.01f)));
+    }
+}
+
+glm::mat4 GenerateProjectionMatrix(float aspect)
+{
+    return glm::frustum(-1.0f, 1.0f, -aspect, aspect, 1.0f, 5000.0f) * glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -100.0f));
+}
+
+static unsigned int seed = 0x13371337;
+
+float RandomFloat(void)
+{
+    float res;
+    unsigned int tmp;
+
+    seed *= 16807;
+
+    tmp = seed ^ (seed >> 4) ^ (seed << 15);
+
+    // Random mantissa under an exponent of 0 gives [1, 2)
+    tmp = (tmp >> 9) | 0x3F800000;
+    memcpy(&res, &tmp, sizeof(res));
+
+    return (res - 1.0f);
+}
+
+glm::vec3 RandomVector(float minmag, float maxmag)
+{
+    glm::vec3 randomvec(RandomFloat() * 2.0f - 1.0f, RandomFloat() * 2.0f - 1.0f, RandomFloat() * 2.0f - 1.0f);
+    randomvec = normalize(randomvec);
+    randomvec *= (RandomFloat() * (maxmag - minmag) + minmag);
+
+    return randomvec;
+}
@@ -0,0 +1,26 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+// The sample's scene: instance colors, the per-frame instance weights and
+// the four model matrices they blend between, and the projection. None of
+// this touches GL so that the software renderer reproduces exactly the
+// same frames.
+#include <glm/glm.hpp>
+
+#define INSTANCE_COUNT 200
+
+// Converts milliseconds since startup into the scene's animation parameter
+float SceneTime(unsigned int app_time);
+
+void GenerateInstanceColors(glm::vec4 * colors, unsigned int count);
+void GenerateInstanceWeights(float t, glm::vec4 * weights, unsigned int count);
+void GenerateModelMatrices(float t, glm::mat4 model_matrix[4]);
+glm::mat4 GenerateProjectionMatrix(float aspect);
+
+// The sample's random number generator, returning values in [0, 1), and a
+// random vector with a length between minmag and maxmag. The sequence is
+// the same on every run.
+float RandomFloat(void);
+glm::vec3 RandomVector(float minmag = 0.0f, float maxmag = 1.0f);
+
+#endif /* __SCENE_H__ */
@@ -4,11 +4,17 @@
 
 VBObject::VBObject(void)
     : m_vao(0),
+      m_depth_vao(0),
+      m_anim_vao(0),
       m_attribute_buffer(0),
       m_index_buffer(0),
+      m_frame_buffer(0),
+      m_frame_texture(0),
       m_attrib(0),
       m_frame(0),
-      m_material(0)
+      m_material(0),
+      m_material_textures(0),
+      m_arena(MEMORY_CPU_MESH)
 {
 
 }
@@ -31,50 +37,36 @@ bool VBObject::LoadFromVBM(const char * filename, int vertexIndex, int normalInd
     fseek(f, 0, SEEK_SET);
 
     unsigned char * data = new unsigned char [filesize];
-    unsigned char * raw_data;
+    MemoryAllocated(MEMORY_CPU_FILE, filesize);
     fread(data, filesize, 1, f);
     fclose(f);
 
-    VBM_HEADER_OLD * oldHeader = (VBM_HEADER_OLD *)data;
-    VBM_HEADER * header = (VBM_HEADER *)data;
-    raw_data = data + header->size + header->num_attribs * sizeof(VBM_ATTRIB_HEADER) + header->num_frames * sizeof(VBM_FRAME_HEADER);
-    VBM_ATTRIB_HEADER * attrib_header = (VBM_ATTRIB_HEADER *)(data + header->size);
-    VBM_FRAME_HEADER * frame_header = (VBM_FRAME_HEADER *)(data + header->size + header->num_attribs * sizeof(VBM_ATTRIB_HEADER));
-    unsigned int total_data_size = 0;
+    VBM_FILE file;
 
-    if (header->magic == 0x314d4253)
+    if (!ParseVBM(data, filesize, &file))
     {
-        memset(&m_header, 0, sizeof(m_header));
-        memcpy(&m_header, header, header->size > sizeof(VBM_HEADER) ? sizeof(VBM_HEADER) : header->size);
-    }
-    else
-    {
-        memcpy(&m_header, oldHeader, sizeof(VBM_HEADER));
-        m_header.num_vertices = oldHeader->num_vertices;
-        m_header.num_indices = oldHeader->num_indices;
-        m_header.index_type = oldHeader->index_type;
-        m_header.num_materials = oldHeader->num_materials;
-        m_header.flags = oldHeader->flags;
+        delete [] data;
+        MemoryFreed(MEMORY_CPU_FILE, filesize);
+        return false;
     }
-    m_attrib = new VBM_ATTRIB_HEADER[m_header.num_attribs];
-    memcpy(m_attrib, attrib_header, m_header.num_attribs * sizeof(VBM_ATTRIB_HEADER));
-    m_frame = new VBM_FRAME_HEADER[m_header.num_frames];
-    memcpy(m_frame, frame_header, m_header.num_frames * sizeof(VBM_FRAME_HEADER));
+
+    unsigned int total_data_size = 0;
+
+    m_header = file.header;
+    m_attrib = m_arena.AllocateArray<VBM_ATTRIB_HEADER>(m_header.num_attribs);
+    memcpy(m_attrib, file.attribs, m_header.num_attribs * sizeof(VBM_ATTRIB_HEADER));
+    m_frame = m_arena.AllocateArray<VBM_FRAME_HEADER>(m_header.num_frames);
+    memcpy(m_frame, file.frames, m_header.num_frames * sizeof(VBM_FRAME_HEADER));
 
     glGenVertexArrays(1, &m_vao);
     glBindVertexArray(m_vao);
     glGenBuffers(1, &m_attribute_buffer);
     glBindBuffer(GL_ARRAY_BUFFER, m_attribute_buffer);
 
-    unsigned int i;
+    glBufferData(GL_ARRAY_BUFFER, file.vertex_data_size, file.vertex_data, GL_STATIC_DRAW);
+    TrackGLBuffer(m_attribute_buffer, MEMORY_GPU_VERTEX, file.vertex_data_size);
 
-    for (i = 0; i < m_header.num_attribs; i++) {
-        total_data_size += m_attrib[i].components * sizeof(GLfloat) * m_header.num_vertices;
-    }
-
-    glBufferData(GL_ARRAY_BUFFER, total_data_size, raw_data, GL_STATIC_DRAW);
-
-    total_data_size = 0;
+    unsigned int i;
 
     for (i = 0; i < m_header.num_attribs; i++) {
         int attribIndex = i;
@@ -88,32 +80,36 @@ bool VBObject::LoadFromVBM(const char * filename, int vertexIndex, int normalInd
 
         glVertexAttribPointer(attribIndex, m_attrib[i].components, m_attrib[i].type, GL_FALSE, 0, (GLvoid *)(unsigned long long)total_data_size);
         glEnableVertexAttribArray(attribIndex);
-        total_data_size += m_attrib[i].components * sizeof(GLfloat) * header->num_vertices;
+        total_data_size += m_attrib[i].components * sizeof(GLfloat) * m_header.num_vertices;
     }
 
     if (m_header.num_indices) {
         glGenBuffers(1, &m_index_buffer);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
-        unsigned int element_size;
-        switch (header->index_type) {
-            case GL_UNSIGNED_SHORT:
-                element_size = sizeof(GLushort);
-                break;
-            default:
-                element_size = sizeof(GLuint);
-                break;
-        }
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_header.num_indices * element_size, raw_data + total_data_size, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, file.index_data_size, file.index_data, GL_STATIC_DRAW);
+        TrackGLBuffer(m_index_buffer, MEMORY_GPU_INDEX, file.index_data_size);
     }
 
+    // Position-only vertex array for depth passes, sharing the same buffers
+    glGenVertexArrays(1, &m_depth_vao);
+    glBindVertexArray(m_depth_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_attribute_buffer);
+    glVertexAttribPointer(vertexIndex, m_attrib[0].components, m_attrib[0].type, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(vertexIndex);
+    if (m_header.num_indices)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer);
+
     glBindVertexArray(0);
 
+    // Without the frame texture the object still draws, just not animated
+    if (m_header.num_frames > 1 && !CreateFrameTexture(file.vertex_data, file.index_data))
+        FreeFrameTexture();
+
     if (m_header.num_materials != 0)
     {
-        m_material = new VBM_MATERIAL[m_header.num_materials];
-        memcpy(m_material, raw_data + total_data_size, m_header.num_materials * sizeof(VBM_MATERIAL));
-        total_data_size += m_header.num_materials * sizeof(VBM_MATERIAL);
-        m_material_textures = new VBObject::material_texture[m_header.num_materials];
+        m_material = m_arena.AllocateArray<VBM_MATERIAL>(m_header.num_materials);
+        memcpy(m_material, file.materials, m_header.num_materials * sizeof(VBM_MATERIAL));
+        m_material_textures = m_arena.AllocateArray<VBObject::material_texture>(m_header.num_materials);
         memset(m_material_textures, 0, m_header.num_materials * sizeof(*m_material_textures));
     }
 
@@ -127,27 +123,128 @@ bool VBObject::LoadFromVBM(const char * filename, int vertexIndex, int normalInd
     */
 
     delete [] data;
+    MemoryFreed(MEMORY_CPU_FILE, filesize);
 
     return true;
 }
 
+bool VBObject::CreateFrameTexture(const unsigned char * vertex_data, const unsigned char * index_data)
+{
+    unsigned int frame_vertices = m_frame[0].count;
+    unsigned int f, i;
+
+    // Keyframes have to line up vertex for vertex, and we need both a
+    // position and a normal to blend
+    for (f = 1; f < m_header.num_frames; f++) {
+        if (m_frame[f].count != frame_vertices)
+            return false;
+    }
+
+    if (m_header.num_attribs < 2 || m_attrib[0].components < 3 || m_attrib[1].components < 3)
+        return false;
+
+    // Two texels per vertex, and texture buffers can be as small as 64k
+    // texels
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if ((unsigned long long)m_header.num_frames * frame_vertices * 2 > (unsigned long long)max_texels)
+        return false;
+
+    const GLfloat * position = (const GLfloat *)vertex_data;
+    const GLfloat * normal = (const GLfloat *)(vertex_data + m_attrib[0].components * sizeof(GLfloat) * m_header.num_vertices);
+
+    // Frames are flattened to non-indexed vertices so the shader can address
+    // them directly as frame * frame_vertices + gl_VertexID
+    const size_t texel_bytes = m_header.num_frames * frame_vertices * 2 * sizeof(glm::vec4);
+    glm::vec4 * texels = new glm::vec4[m_header.num_frames * frame_vertices * 2];
+    MemoryAllocated(MEMORY_CPU_STAGING, texel_bytes);
+    glm::vec4 * texel = texels;
+
+    for (f = 0; f < m_header.num_frames; f++) {
+        for (i = 0; i < frame_vertices; i++) {
+            unsigned int element = m_frame[f].first + i;
+            unsigned int vertex = element;
+
+            if (m_header.num_indices) {
+                if (m_header.index_type == GL_UNSIGNED_SHORT)
+                    vertex = ((const GLushort *)index_data)[element];
+                else
+                    vertex = ((const GLuint *)index_data)[element];
+            }
+
+            const GLfloat * p = position + vertex * m_attrib[0].components;
+            const GLfloat * n = normal + vertex * m_attrib[1].components;
+
+            *texel++ = glm::vec4(p[0], p[1], p[2], 1.0f);
+            *texel++ = glm::vec4(n[0], n[1], n[2], 0.0f);
+        }
+    }
+
+    // Drop errors left by earlier calls so that the check after the upload
+    // only sees its own
+    while (glGetError() != GL_NO_ERROR)
+        ;
+
+    glGenBuffers(1, &m_frame_buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_frame_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, texel_bytes, texels, GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    delete [] texels;
+    MemoryFreed(MEMORY_CPU_STAGING, texel_bytes);
+
+    // An incomplete buffer would have the shader read garbage
+    if (glGetError() != GL_NO_ERROR)
+        return false;
+
+    TrackGLBuffer(m_frame_buffer, MEMORY_GPU_TEXTURE, texel_bytes);
+
+    glGenTextures(1, &m_frame_texture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_frame_texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_frame_buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // The storage is the buffer's and is already counted there
+    TrackGLTexture(m_frame_texture, MEMORY_GPU_TEXTURE, 0);
+
+    glGenVertexArrays(1, &m_anim_vao);
+
+    return true;
+}
+
+void VBObject::FreeFrameTexture(void)
+{
+    UntrackGLBuffer(m_frame_buffer);
+    UntrackGLTexture(m_frame_texture);
+
+    glDeleteVertexArrays(1, &m_anim_vao);
+    m_anim_vao = 0;
+    glDeleteTextures(1, &m_frame_texture);
+    m_frame_texture = 0;
+    glDeleteBuffers(1, &m_frame_buffer);
+    m_frame_buffer = 0;
+}
+
 bool VBObject::Free(void)
 {
+    UntrackGLBuffer(m_index_buffer);
+    UntrackGLBuffer(m_attribute_buffer);
+
     glDeleteBuffers(1, &m_index_buffer);
     m_index_buffer = 0;
     glDeleteBuffers(1, &m_attribute_buffer);
     m_attribute_buffer = 0;
     glDeleteVertexArrays(1, &m_vao);
     m_vao = 0;
+    glDeleteVertexArrays(1, &m_depth_vao);
+    m_depth_vao = 0;
+    FreeFrameTexture();
 
-    delete [] m_attrib;
+    m_arena.Release();
     m_attrib = NULL;
-
-    delete [] m_frame;
     m_frame = NULL;
-
-    delete [] m_material;
     m_material = NULL;
+    m_material_textures = NULL;
 
     return true;
 }
@@ -182,18 +279,49 @@ void VBObject::Render(unsigned int frame_index, unsigned int instances)
     }
     else
     */
-    {
-        if (instances) {
-            if (m_header.num_indices)
-                glDrawElementsInstanced(GL_TRIANGLES, m_frame[frame_index].count, GL_UNSIGNED_INT, (GLvoid *)(m_frame[frame_index].first * sizeof(GLuint)), instances);
-            else
-                glDrawArraysInstanced(GL_TRIANGLES, m_frame[frame_index].first, m_frame[frame_index].count, instances);
-        } else {
-            if (m_header.num_indices)
-                glDrawElements(GL_TRIANGLES, m_frame[frame_index].count, GL_UNSIGNED_INT, (GLvoid *)(m_frame[frame_index].first * sizeof(GLuint)));
-            else
-                glDrawArrays(GL_TRIANGLES, m_frame[frame_index].first, m_frame[frame_index].count);
-        }
-    }
+    DrawFrame(frame_index, instances);
     glBindVertexArray(0);
 }
+
+void VBObject::RenderDepth(unsigned int frame_index, unsigned int instances)
+{
+    if (frame_index >= m_header.num_frames)
+        return;
+
+    glBindVertexArray(m_depth_vao);
+    DrawFrame(frame_index, instances);
+    glBindVertexArray(0);
+}
+
+void VBObject::RenderAnimated(unsigned int instances)
+{
+    if (m_frame_texture == 0)
+        return;
+
+    glBindVertexArray(m_anim_vao);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_frame_texture);
+
+    if (instances)
+        glDrawArraysInstanced(GL_TRIANGLES, 0, m_frame[0].count, instances);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, m_frame[0].count);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void VBObject::DrawFrame(unsigned int frame_index, unsigned int instances)
+{
+    if (instances) {
+        if (m_header.num_indices)
+            glDrawElementsInstanced(GL_TRIANGLES, m_frame[frame_index].count, GL_UNSIGNED_INT, (GLvoid *)(m_frame[frame_index].first * sizeof(GLuint)), instances);
+        else
+            glDrawArraysInstanced(GL_TRIANGLES, m_frame[frame_index].first, m_frame[frame_index].count, instances);
+    } else {
+        if (m_header.num_indices)
+            glDrawElements(GL_TRIANGLES, m_frame[frame_index].count, GL_UNSIGNED_INT, (GLvoid *)(m_frame[frame_index].first * sizeof(GLuint)));
+        else
+            glDrawArrays(GL_TRIANGLES, m_frame[frame_index].first, m_frame[frame_index].count);
+    }
+}
@@ -7,10 +7,15 @@
 // file. Note that in that case, gl.h doesn't get included and so in order
 // to include some of the tokens required by the files (GL_UNSIGNED_INT,
 // for example), you'll need to define them yourself.
+#ifndef VBM_FILE_TYPES_ONLY
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "memtrack.h"
+#endif /* VBM_FILE_TYPES_ONLY */
+
+#include <stddef.h>
 
 #define VBM_FLAG_HAS_VERTICES       0x00000001
 #define VBM_FLAG_HAS_INDICES        0x00000002
@@ -107,6 +112,25 @@ typedef struct VBM_MATERIAL_t
     char normal_map[64];        /// Normal map (texture)
 } VBM_MATERIAL;
 
+// A VBM file parsed in place. All pointers point into the buffer handed to
+// ParseVBM, and the header is normalized to the current layout.
+typedef struct VBM_FILE_t
+{
+    VBM_HEADER header;
+    const VBM_ATTRIB_HEADER * attribs;
+    const VBM_FRAME_HEADER * frames;
+    const unsigned char * vertex_data;
+    size_t vertex_data_size;
+    const unsigned char * index_data;
+    size_t index_data_size;
+    const VBM_MATERIAL * materials;
+} VBM_FILE;
+
+// Checks that everything the header describes lies within size bytes and
+// that every index refers to a vertex. Returns false for truncated or
+// malformed files.
+bool ParseVBM(const unsigned char * data, size_t size, VBM_FILE * file);
+
 #ifndef VBM_FILE_TYPES_ONLY
 
 class VBObject
@@ -117,6 +141,8 @@ public:
 
     bool LoadFromVBM(const char * filename, int vertexIndex, int normalIndex, int texCoord0Index);
     void Render(unsigned int frame_index = 0, unsigned int instances = 0);
+    void RenderDepth(unsigned int frame_index = 0, unsigned int instances = 0);
+    void RenderAnimated(unsigned int instances = 0);
     bool Free(void);
 
     unsigned int GetVertexCount(unsigned int frame = 0)
@@ -194,10 +220,38 @@ public:
         glBindVertexArray(m_vao);
     }
 
+    // The depth vertex array only sources the position attribute, which is
+    // the first (and contiguous) stream in the attribute buffer
+    void BindDepthVertexArray()
+    {
+        glBindVertexArray(m_depth_vao);
+    }
+
+    // Frame animation is only available when every frame has the same
+    // vertex count. The animation vertex array has no per-vertex attributes;
+    // the shader fetches vertices from the frame texture by gl_VertexID.
+    bool HasFrameAnimation(void) const
+    {
+        return m_frame_texture != 0;
+    }
+
+    void BindAnimationVertexArray()
+    {
+        glBindVertexArray(m_anim_vao);
+    }
+
 protected:
+    void DrawFrame(unsigned int frame_index, unsigned int instances);
+    bool CreateFrameTexture(const unsigned char * vertex_data, const unsigned char * index_data);
+    void FreeFrameTexture(void);
+
     GLuint m_vao;
+    GLuint m_depth_vao;
+    GLuint m_anim_vao;
     GLuint m_attribute_buffer;
     GLuint m_index_buffer;
+    GLuint m_frame_buffer;
+    GLuint m_frame_texture;
 
     VBM_HEADER m_header;
     VBM_ATTRIB_HEADER * m_attrib;
@@ -213,6 +267,9 @@ protected:
     };
 
     material_texture * m_material_textures;
+
+    // Holds m_attrib, m_frame, m_material and m_material_textures
+    MemoryArena m_arena;
 };
 #endif /* VBM_FILE_TYPES_ONLY */
 
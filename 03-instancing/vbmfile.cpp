@@ -0,0 +1,100 @@
+#define VBM_FILE_TYPES_ONLY
+#include "vbm.h"
+#include <string.h>
+
+#ifndef GL_UNSIGNED_SHORT
+#define GL_UNSIGNED_SHORT           0x1403
+#endif
+
+bool ParseVBM(const unsigned char * data, size_t size, VBM_FILE * file)
+{
+    const VBM_HEADER * header = (const VBM_HEADER *)data;
+    const VBM_HEADER_OLD * oldHeader = (const VBM_HEADER_OLD *)data;
+    unsigned long long offset;
+    unsigned long long length;
+    unsigned int i;
+
+    memset(file, 0, sizeof(*file));
+
+    if (size < sizeof(VBM_HEADER_OLD))
+        return false;
+
+    if (header->magic == 0x314d4253)
+    {
+        memcpy(&file->header, header, header->size > sizeof(VBM_HEADER) ? sizeof(VBM_HEADER) : header->size);
+    }
+    else
+    {
+        memcpy(&file->header, oldHeader, sizeof(VBM_HEADER));
+        file->header.num_vertices = oldHeader->num_vertices;
+        file->header.num_indices = oldHeader->num_indices;
+        file->header.index_type = oldHeader->index_type;
+        file->header.num_materials = oldHeader->num_materials;
+        file->header.flags = oldHeader->flags;
+    }
+
+    // Sizes are computed in 64 bits so that bogus counts can't wrap around
+    // and pass the bounds checks
+    offset = header->size;
+    length = (unsigned long long)file->header.num_attribs * sizeof(VBM_ATTRIB_HEADER);
+    if (offset > size || length > size - offset)
+        return false;
+    file->attribs = (const VBM_ATTRIB_HEADER *)(data + offset);
+    offset += length;
+
+    length = (unsigned long long)file->header.num_frames * sizeof(VBM_FRAME_HEADER);
+    if (length > size - offset)
+        return false;
+    file->frames = (const VBM_FRAME_HEADER *)(data + offset);
+    offset += length;
+
+    // Attributes are planar and stored as floats
+    length = 0;
+    for (i = 0; i < file->header.num_attribs; i++)
+        length += (unsigned long long)file->attribs[i].components * sizeof(float) * file->header.num_vertices;
+    if (length > size - offset)
+        return false;
+    file->vertex_data = data + offset;
+    file->vertex_data_size = (size_t)length;
+    offset += length;
+
+    length = (unsigned long long)file->header.num_indices *
+             (file->header.index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
+    if (length > size - offset)
+        return false;
+    file->index_data = data + offset;
+    file->index_data_size = (size_t)length;
+    offset += length;
+
+    // Indices are also used to look up vertex data on the CPU, so every one
+    // of them has to land inside the vertex arrays
+    if (file->header.index_type == GL_UNSIGNED_SHORT) {
+        const unsigned short * indices = (const unsigned short *)file->index_data;
+        for (i = 0; i < file->header.num_indices; i++) {
+            if (indices[i] >= file->header.num_vertices)
+                return false;
+        }
+    } else {
+        const unsigned int * indices = (const unsigned int *)file->index_data;
+        for (i = 0; i < file->header.num_indices; i++) {
+            if (indices[i] >= file->header.num_vertices)
+                return false;
+        }
+    }
+
+    for (i = 0; i < file->header.num_frames; i++) {
+        unsigned long long end = (unsigned long long)file->frames[i].first + file->frames[i].count;
+        if (end > (file->header.num_indices ? file->header.num_indices : file->header.num_vertices))
+            return false;
+    }
+
+    // Some exporters leave the material table off while still counting
+    // materials; the geometry is fine without them
+    length = (unsigned long long)file->header.num_materials * sizeof(VBM_MATERIAL);
+    if (length > size - offset)
+        file->header.num_materials = 0;
+    else if (file->header.num_materials != 0)
+        file->materials = (const VBM_MATERIAL *)(data + offset);
+
+    return true;
+}
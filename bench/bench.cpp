@@ -0,0 +1,284 @@
+// bench - microbenchmarks for the instancing sample's CPU paths
+//
+// Each benchmark is swept over a few problem sizes and reports time per
+// iteration, throughput and allocations per iteration. Results can be
+// written as JSON and compared against an earlier run with compare.py.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#include "bench.h"
+
+static std::atomic<unsigned long long> s_allocations(0);
+
+const void * volatile bench_escape;
+
+// Every allocation through new goes through operator new, which is all the
+// counting needs. The array forms forward to these; the sized delete that
+// C++14 compilers call is replaced too so that it also reaches our free().
+void * operator new(size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void * p = malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete(void * p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+    free(p);
+}
+
+unsigned long long GetAllocationCount(void)
+{
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+BenchmarkRunner::BenchmarkRunner(void)
+    : m_min_time_ms(100.0),
+      m_repetitions(5),
+      m_failures(0)
+{
+
+}
+
+void BenchmarkRunner::SetFilter(const char * filter)
+{
+    m_filter = filter;
+}
+
+void BenchmarkRunner::SetMinTime(double ms)
+{
+    m_min_time_ms = ms;
+}
+
+void BenchmarkRunner::SetRepetitions(unsigned int repetitions)
+{
+    m_repetitions = repetitions ? repetitions : 1;
+}
+
+void BenchmarkRunner::Fail(const char * reason)
+{
+    if (m_failure.empty())
+        m_failure = reason;
+}
+
+static double TimeRun(void (*func)(void *, unsigned long long), void * context, unsigned long long iterations)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    func(context, iterations);
+
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BenchmarkRunner::RunFunction(const char * name, unsigned int size, double items, double bytes,
+                                  BenchFunction func, void * context)
+{
+    const double min_time_ns = m_min_time_ms * 1000000.0;
+    unsigned long long iterations = 1;
+    std::vector<double> samples;
+    unsigned long long allocations = 0;
+    unsigned int i;
+
+    if (!m_filter.empty() && strstr(name, m_filter.c_str()) == NULL)
+        return;
+
+    m_failure.clear();
+
+    // Find an iteration count that takes at least the minimum time. This
+    // doubles as the warm-up.
+    for (;;) {
+        double elapsed = TimeRun(func, context, iterations);
+
+        if (elapsed >= min_time_ns || iterations >= (1ULL << 40) || !m_failure.empty())
+            break;
+
+        // Aim a little past the minimum, but never grow more than 10x in a
+        // step in case the first runs were dominated by warming up
+        double scale = elapsed > 0.0 ? min_time_ns * 1.2 / elapsed : 10.0;
+        scale = std::min(std::max(scale, 2.0), 10.0);
+        iterations = (unsigned long long)(iterations * scale);
+    }
+
+    for (i = 0; i < m_repetitions && m_failure.empty(); i++) {
+        unsigned long long start_allocations = GetAllocationCount();
+        double elapsed = TimeRun(func, context, iterations);
+
+        allocations += GetAllocationCount() - start_allocations;
+        samples.push_back(elapsed / iterations);
+    }
+
+    if (!m_failure.empty()) {
+        printf("%-24s %8u FAILED: %s\n", name, size, m_failure.c_str());
+        fflush(stdout);
+        m_failures++;
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    BENCH_RESULT result;
+
+    result.name = name;
+    result.size = size;
+    result.iterations = iterations;
+    result.repetitions = m_repetitions;
+    result.ns_per_iter = samples[samples.size() / 2];
+    result.min_ns_per_iter = samples[0];
+    result.items_per_second = result.ns_per_iter > 0.0 ? items * 1e9 / result.ns_per_iter : 0.0;
+    result.bytes_per_second = result.ns_per_iter > 0.0 ? bytes * 1e9 / result.ns_per_iter : 0.0;
+    result.allocs_per_iter = double(allocations) / (double(iterations) * m_repetitions);
+
+    printf("%-24s %8u %12.1f ns %12.4g items/s %10.1f MB/s %8.2f allocs\n",
+           name, size, result.ns_per_iter, result.items_per_second,
+           result.bytes_per_second / (1024.0 * 1024.0), result.allocs_per_iter);
+    fflush(stdout);
+
+    m_results.push_back(result);
+}
+
+// Names are plain identifiers, but escape them anyway so that the output is
+// always valid JSON
+static void WriteJSONString(FILE * f, const std::string & s)
+{
+    size_t i;
+
+    fputc('"', f);
+    for (i = 0; i < s.size(); i++) {
+        unsigned char c = (unsigned char)s[i];
+
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+bool BenchmarkRunner::WriteJSON(const char * filename) const
+{
+    FILE * f = fopen(filename, "w");
+    size_t i;
+
+    if (f == NULL)
+        return false;
+
+#ifdef _DEBUG
+    const char * build = "debug";
+#else
+    const char * build = "release";
+#endif
+
+    fprintf(f, "{\n  \"context\": {\n");
+    fprintf(f, "    \"time\": %lld,\n", (long long)time(NULL));
+    fprintf(f, "    \"build\": \"%s\",\n", build);
+    fprintf(f, "    \"pointer_size\": %u,\n", (unsigned int)sizeof(void *));
+    fprintf(f, "    \"min_time_ms\": %.9g,\n", m_min_time_ms);
+    fprintf(f, "    \"repetitions\": %u\n", m_repetitions);
+    fprintf(f, "  },\n  \"benchmarks\": [\n");
+
+    for (i = 0; i < m_results.size(); i++) {
+        const BENCH_RESULT & result = m_results[i];
+
+        fprintf(f, "    {\"name\": ");
+        WriteJSONString(f, result.name);
+        fprintf(f, ", \"size\": %u, \"iterations\": %llu, \"repetitions\": %u, "
+                   "\"ns_per_iter\": %.9g, \"min_ns_per_iter\": %.9g, "
+                   "\"items_per_second\": %.9g, \"bytes_per_second\": %.9g, \"allocs_per_iter\": %.9g}%s\n",
+                result.size, result.iterations, result.repetitions,
+                result.ns_per_iter, result.min_ns_per_iter,
+                result.items_per_second, result.bytes_per_second, result.allocs_per_iter,
+                i + 1 < m_results.size() ? "," : "");
+    }
+
+    fprintf(f, "  ]\n}\n");
+
+    bool ok = ferror(f) == 0;
+    if (fclose(f) != 0)
+        ok = false;
+
+    return ok;
+}
+
+static void Usage(void)
+{
+    printf("Usage: bench [options]\n"
+           "\n"
+           "Options:\n"
+           "  -filter TEXT       only run benchmarks whose name contains TEXT\n"
+           "  -min-time MS       minimum duration of each timed run (default 100)\n"
+           "  -repetitions N     timed runs per benchmark; the median is reported\n"
+           "                     (default 5)\n"
+           "  -json FILE         write the results to FILE as JSON\n"
+           "  -vbm FILE          also time parsing FILE\n"
+           "  -gl                also run the buffer upload benchmarks, which need\n"
+           "                     an OpenGL context\n");
+}
+
+int main(int argc, char ** argv)
+{
+    BenchmarkRunner runner;
+    const char * json_filename = NULL;
+    const char * vbm_filename = NULL;
+    bool gl = false;
+    int arg;
+
+    for (arg = 1; arg < argc; arg++) {
+        bool has_value = arg + 1 < argc;
+
+        if (strcmp(argv[arg], "-filter") == 0 && has_value) {
+            runner.SetFilter(argv[++arg]);
+        } else if (strcmp(argv[arg], "-min-time") == 0 && has_value) {
+            runner.SetMinTime(atof(argv[++arg]));
+        } else if (strcmp(argv[arg], "-repetitions") == 0 && has_value) {
+            runner.SetRepetitions((unsigned int)atoi(argv[++arg]));
+        } else if (strcmp(argv[arg], "-json") == 0 && has_value) {
+            json_filename = argv[++arg];
+        } else if (strcmp(argv[arg], "-vbm") == 0 && has_value) {
+            vbm_filename = argv[++arg];
+        } else if (strcmp(argv[arg], "-gl") == 0) {
+            gl = true;
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+
+    printf("%-24s %8s %15s %20s %15s %15s\n", "benchmark", "size", "time", "items", "bandwidth", "allocations");
+
+    RunCPUBenchmarks(runner, vbm_filename);
+
+    if (gl && !RunUploadBenchmarks(runner))
+        fprintf(stderr, "Unable to create an OpenGL context; upload benchmarks skipped\n");
+
+    if (json_filename != NULL && !runner.WriteJSON(json_filename)) {
+        fprintf(stderr, "%s: unable to write results\n", json_filename);
+        return 1;
+    }
+
+    // Failed benchmarks have no results, so a comparison would only show
+    // them as missing
+    if (runner.GetFailureCount() != 0) {
+        fprintf(stderr, "%u benchmark%s failed\n", runner.GetFailureCount(), runner.GetFailureCount() == 1 ? "" : "s");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+// Microbenchmark harness. A benchmark is a function that runs its workload
+// a given number of times; the harness grows that number until one run
+// takes at least the minimum time, then repeats the run and reports the
+// median. Allocations are counted through the global operator new, so
+// allocations made with malloc() don't show up.
+#include <string>
+#include <vector>
+
+typedef struct BENCH_RESULT_t
+{
+    std::string name;
+    unsigned int size;                  // problem size the benchmark was swept over
+    unsigned long long iterations;      // per repetition
+    unsigned int repetitions;
+    double ns_per_iter;                 // median over the repetitions
+    double min_ns_per_iter;
+    double items_per_second;            // at the median
+    double bytes_per_second;
+    double allocs_per_iter;
+} BENCH_RESULT;
+
+// Number of operator new calls so far, on any thread
+unsigned long long GetAllocationCount(void);
+
+// Stores a pointer somewhere the compiler has to assume is read, so that
+// work whose results are otherwise unused doesn't get optimized away
+extern const void * volatile bench_escape;
+
+static inline void Escape(const void * p)
+{
+    bench_escape = p;
+}
+
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(void);
+
+    void SetFilter(const char * filter);
+    void SetMinTime(double ms);
+    void SetRepetitions(unsigned int repetitions);
+
+    // Runs func(iterations) if the name matches the filter. items and bytes
+    // are the work done by one iteration and only feed the throughput
+    // figures; either can be 0.
+    template <typename F>
+    void Run(const char * name, unsigned int size, double items, double bytes, F func)
+    {
+        RunFunction(name, size, items, bytes, &Invoke<F>, &func);
+    }
+
+    // Called from inside a benchmark that couldn't do its work, such as a
+    // GPU wait that timed out. The remaining runs are skipped and the
+    // benchmark is reported as failed instead of getting a result.
+    void Fail(const char * reason);
+
+    const std::vector<BENCH_RESULT> & GetResults(void) const
+    {
+        return m_results;
+    }
+
+    unsigned int GetFailureCount(void) const
+    {
+        return m_failures;
+    }
+
+    bool WriteJSON(const char * filename) const;
+
+protected:
+    typedef void (*BenchFunction)(void * context, unsigned long long iterations);
+
+    template <typename F>
+    static void Invoke(void * context, unsigned long long iterations)
+    {
+        (*static_cast<F *>(context))(iterations);
+    }
+
+    void RunFunction(const char * name, unsigned int size, double items, double bytes,
+                     BenchFunction func, void * context);
+
+    std::string m_filter;
+    double m_min_time_ms;
+    unsigned int m_repetitions;
+    std::vector<BENCH_RESULT> m_results;
+    std::string m_failure;              // reason, or empty while the current benchmark is fine
+    unsigned int m_failures;
+};
+
+// The benchmark tiers. The CPU tier is GL-free; the upload tier creates a
+// hidden window for its context and returns false if it can't get one.
+// A non-NULL vbm_filename adds a benchmark that parses that file.
+void RunCPUBenchmarks(BenchmarkRunner & runner, const char * vbm_filename);
+bool RunUploadBenchmarks(BenchmarkRunner & runner);
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# compare.py - compares two result files written by bench -json
+#
+# Benchmarks are matched by name and size. A benchmark regresses when its
+# median time per iteration grows by more than the threshold, or when it
+# allocates more per iteration than it used to. The exit code is 1 if
+# anything regressed, so this can gate a build.
+
+import argparse
+import json
+import sys
+
+
+def load(filename):
+    with open(filename) as f:
+        results = json.load(f)
+
+    return {(b['name'], b['size']): b for b in results['benchmarks']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two bench -json result files.')
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('-threshold', type=float, default=10.0,
+                        help='slowdown in percent that counts as a regression (default 10)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    regressions = 0
+
+    print('%-24s %8s %14s %14s %9s' % ('benchmark', 'size', 'baseline ns', 'current ns', 'change'))
+
+    for key in sorted(set(baseline) | set(current)):
+        name, size = key
+
+        if key not in current:
+            print('%-24s %8u %14.1f %14s %9s' % (name, size, baseline[key]['ns_per_iter'], '-', 'missing'))
+            continue
+        if key not in baseline:
+            print('%-24s %8u %14s %14.1f %9s' % (name, size, '-', current[key]['ns_per_iter'], 'new'))
+            continue
+
+        old = baseline[key]
+        new = current[key]
+        change = (new['ns_per_iter'] / old['ns_per_iter'] - 1.0) * 100.0 if old['ns_per_iter'] > 0 else 0.0
+        notes = []
+
+        if change > args.threshold:
+            notes.append('SLOWER')
+        # Allocation counts are exact, so any increase is real
+        if new['allocs_per_iter'] > old['allocs_per_iter'] + 1e-9:
+            notes.append('ALLOCS %.2f -> %.2f' % (old['allocs_per_iter'], new['allocs_per_iter']))
+        if notes:
+            regressions += 1
+
+        print('%-24s %8u %14.1f %14.1f %+8.1f%% %s' %
+              (name, size, old['ns_per_iter'], new['ns_per_iter'], change, ' '.join(notes)))
+
+    if regressions:
+        print('%d regression%s above %.1f%%' % (regressions, '' if regressions == 1 else 's', args.threshold))
+        return 1
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,185 @@
+// CPU benchmarks: the loader and the per-frame work Display() does before
+// anything reaches GL
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define VBM_FILE_TYPES_ONLY
+#include "vbm.h"
+#include "scene.h"
+#include "instances.h"
+#include "bench.h"
+
+// Builds an in-memory VBM file with a position and a normal attribute and
+// the given number of frames, all sharing the same vertices
+static void BuildVBM(unsigned int vertices, unsigned int frames, std::vector<unsigned char> & data)
+{
+    VBM_HEADER header;
+    VBM_ATTRIB_HEADER attribs[2];
+    unsigned int i;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = 0x314d4253;
+    header.size = sizeof(VBM_HEADER);
+    header.num_attribs = 2;
+    header.num_frames = frames;
+    header.num_vertices = vertices;
+
+    memset(attribs, 0, sizeof(attribs));
+    strcpy(attribs[0].name, "position");
+    attribs[0].components = 4;
+    strcpy(attribs[1].name, "normal");
+    attribs[1].components = 3;
+
+    data.clear();
+    data.insert(data.end(), (const unsigned char *)&header, (const unsigned char *)(&header + 1));
+    data.insert(data.end(), (const unsigned char *)attribs, (const unsigned char *)(attribs + 2));
+
+    for (i = 0; i < frames; i++) {
+        VBM_FRAME_HEADER frame;
+
+        frame.first = 0;
+        frame.count = vertices;
+        frame.flags = 0;
+        data.insert(data.end(), (const unsigned char *)&frame, (const unsigned char *)(&frame + 1));
+    }
+
+    data.resize(data.size() + (size_t)vertices * (4 + 3) * sizeof(float));
+}
+
+static bool LoadFile(const char * filename, std::vector<unsigned char> & data)
+{
+    FILE * f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    size_t filesize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    data.resize(filesize);
+    size_t read = filesize ? fread(&data[0], filesize, 1, f) : 0;
+    fclose(f);
+
+    return read == 1;
+}
+
+void RunCPUBenchmarks(BenchmarkRunner & runner, const char * vbm_filename)
+{
+    static const unsigned int frame_counts[] = { 1, 64, 4096 };
+    static const unsigned int instance_counts[] = { INSTANCE_COUNT, 4096, 65536, 1048576 };
+    static const unsigned int matrix_counts[] = { 1, 64, 4096 };
+    std::vector<unsigned char> file_data;
+    unsigned int i;
+
+    // Header and section parsing, as done by LoadFromVBM. The vertex data is
+    // only bounds-checked, so the frame table is what scales.
+    for (i = 0; i < sizeof(frame_counts) / sizeof(frame_counts[0]); i++) {
+        const unsigned int frames = frame_counts[i];
+
+        BuildVBM(1024, frames, file_data);
+        runner.Run("parse_vbm", frames, frames, 0.0, [&](unsigned long long iterations) {
+            VBM_FILE file;
+
+            for (unsigned long long n = 0; n < iterations; n++) {
+                ParseVBM(&file_data[0], file_data.size(), &file);
+                Escape(&file);
+            }
+        });
+    }
+
+    if (vbm_filename != NULL) {
+        if (LoadFile(vbm_filename, file_data)) {
+            // Size is the file size, but only the headers and indices are
+            // actually read
+            runner.Run("parse_vbm_file", (unsigned int)file_data.size(), 1.0, 0.0, [&](unsigned long long iterations) {
+                VBM_FILE file;
+
+                for (unsigned long long n = 0; n < iterations; n++) {
+                    ParseVBM(&file_data[0], file_data.size(), &file);
+                    Escape(&file);
+                }
+            });
+        } else {
+            fprintf(stderr, "%s: unable to read file\n", vbm_filename);
+        }
+    }
+
+    for (i = 0; i < sizeof(instance_counts) / sizeof(instance_counts[0]); i++) {
+        const unsigned int count = instance_counts[i];
+        std::vector<glm::vec4> weights(count);
+
+        runner.Run("instance_weights", count, count, count * sizeof(glm::vec4), [&](unsigned long long iterations) {
+            for (unsigned long long n = 0; n < iterations; n++) {
+                GenerateInstanceWeights(float(n & 0xFFFF) / 65536.0f, &weights[0], count);
+                Escape(&weights[0]);
+            }
+        });
+    }
+
+    // Each set is the four matrices the instances blend between
+    for (i = 0; i < sizeof(matrix_counts) / sizeof(matrix_counts[0]); i++) {
+        const unsigned int count = matrix_counts[i];
+        std::vector<glm::mat4> matrices(count * 4);
+
+        runner.Run("model_matrices", count, count * 4, count * 4 * sizeof(glm::mat4), [&](unsigned long long iterations) {
+            for (unsigned long long n = 0; n < iterations; n++) {
+                for (unsigned int set = 0; set < count; set++)
+                    GenerateModelMatrices(float((n + set) & 0xFFFF) / 65536.0f, &matrices[set * 4]);
+                Escape(&matrices[0]);
+            }
+        });
+    }
+
+    for (i = 0; i < sizeof(instance_counts) / sizeof(instance_counts[0]); i++) {
+        const unsigned int count = instance_counts[i];
+        std::vector<glm::vec3> vectors(count);
+
+        runner.Run("random_vector", count, count, count * sizeof(glm::vec3), [&](unsigned long long iterations) {
+            for (unsigned long long n = 0; n < iterations; n++) {
+                for (unsigned int v = 0; v < count; v++)
+                    vectors[v] = RandomVector(0.5f, 1.0f);
+                Escape(&vectors[0]);
+            }
+        });
+    }
+
+    // What the governor does each frame: find the depth of every instance,
+    // sort front to back, cut at half the depth range and gather the weights
+    // and colors of the instances that are kept
+    glm::mat4 model_matrix[4];
+    glm::mat4 projection_matrix(GenerateProjectionMatrix(0.75f));
+
+    GenerateModelMatrices(0.25f, model_matrix);
+
+    for (i = 0; i < sizeof(instance_counts) / sizeof(instance_counts[0]); i++) {
+        const unsigned int count = instance_counts[i];
+        std::vector<glm::vec4> weights(count);
+        std::vector<glm::vec4> colors(count);
+        std::vector<float> depth(count);
+        std::vector<unsigned int> order(count);
+        unsigned int bucket_end[INSTANCE_DEPTH_BUCKETS];
+        std::vector<glm::vec4> kept_weights(count);
+        std::vector<glm::vec4> kept_colors(count);
+
+        GenerateInstanceWeights(0.25f, &weights[0], count);
+        GenerateInstanceColors(&colors[0], count);
+
+        runner.Run("instance_compaction", count, count, count * 2 * sizeof(glm::vec4), [&](unsigned long long iterations) {
+            for (unsigned long long n = 0; n < iterations; n++) {
+                ComputeInstanceDepths(projection_matrix, model_matrix, &weights[0], count, &depth[0]);
+                SortInstancesFrontToBack(&depth[0], count, &order[0], bucket_end);
+
+                unsigned int kept = CountInstancesWithinDepth(bucket_end, 0.5f);
+
+                for (unsigned int k = 0; k < kept; k++) {
+                    kept_weights[k] = weights[order[k]];
+                    kept_colors[k] = colors[order[k]];
+                }
+                Escape(&kept_weights[0]);
+                Escape(&kept_colors[0]);
+            }
+        });
+    }
+}
@@ -0,0 +1,145 @@
+// Upload benchmarks: three ways of getting the per-frame instance weights
+// into a buffer. Each timed run ends with glFinish() so that copies the
+// driver defers are still counted.
+
+#include <string.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "scene.h"
+#include "bench.h"
+
+// Segments in the mapped ring; a segment is only rewritten once the GPU is
+// done with the upload before last
+#define UPLOAD_RING_SEGMENTS        3
+
+// Fence waits are split into steps of UPLOAD_WAIT_TIMEOUT nanoseconds and
+// give up after UPLOAD_MAX_WAITS of them, so that a stuck fence fails the
+// benchmark rather than hanging the run
+#define UPLOAD_WAIT_TIMEOUT         100000000
+#define UPLOAD_MAX_WAITS            20
+
+static bool WaitFence(GLsync fence)
+{
+    unsigned int i;
+
+    for (i = 0; i < UPLOAD_MAX_WAITS; i++) {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UPLOAD_WAIT_TIMEOUT);
+
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            return true;
+        if (status == GL_WAIT_FAILED)
+            return false;
+    }
+
+    return false;
+}
+
+bool RunUploadBenchmarks(BenchmarkRunner & runner)
+{
+    static const unsigned int instance_counts[] = { INSTANCE_COUNT, 4096, 65536, 1048576 };
+    unsigned int i;
+
+    if (!glfwInit())
+        return false;
+
+    // There's nothing to show, so the window stays hidden
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow * window = glfwCreateWindow(64, 64, "bench", NULL, NULL);
+
+    if (window == NULL) {
+        glfwTerminate();
+        return false;
+    }
+
+    glfwMakeContextCurrent(window);
+    glewExperimental = GL_TRUE;
+
+    if (glewInit() != GLEW_OK || !GLEW_VERSION_3_2) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return false;
+    }
+
+    GLuint buffer;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    for (i = 0; i < sizeof(instance_counts) / sizeof(instance_counts[0]); i++) {
+        const unsigned int count = instance_counts[i];
+        const GLsizeiptr size = count * sizeof(glm::vec4);
+        std::vector<glm::vec4> weights(count);
+
+        GenerateInstanceWeights(0.25f, &weights[0], count);
+
+        // What Display() does: respecify the whole buffer every frame and
+        // let the driver orphan the old storage
+        runner.Run("upload_buffer_data", count, count, double(size), [&](unsigned long long iterations) {
+            for (unsigned long long n = 0; n < iterations; n++)
+                glBufferData(GL_ARRAY_BUFFER, size, &weights[0], GL_DYNAMIC_DRAW);
+            glFinish();
+        });
+
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+
+        runner.Run("upload_buffer_sub_data", count, count, double(size), [&](unsigned long long iterations) {
+            for (unsigned long long n = 0; n < iterations; n++)
+                glBufferSubData(GL_ARRAY_BUFFER, 0, size, &weights[0]);
+            glFinish();
+        });
+
+        // Unsynchronized writes into a ring of segments, with a fence per
+        // segment standing in for the draw that would read it
+        glBufferData(GL_ARRAY_BUFFER, size * UPLOAD_RING_SEGMENTS, NULL, GL_DYNAMIC_DRAW);
+
+        runner.Run("upload_mapped_ring", count, count, double(size), [&](unsigned long long iterations) {
+            GLsync fences[UPLOAD_RING_SEGMENTS] = { 0 };
+            unsigned int segment;
+            bool stalled = false;
+
+            for (unsigned long long n = 0; n < iterations; n++) {
+                segment = (unsigned int)(n % UPLOAD_RING_SEGMENTS);
+
+                if (fences[segment] != 0) {
+                    stalled = !WaitFence(fences[segment]);
+
+                    glDeleteSync(fences[segment]);
+                    fences[segment] = 0;
+                    if (stalled)
+                        break;
+                }
+
+                void * data = glMapBufferRange(GL_ARRAY_BUFFER, segment * size, size,
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                if (data != NULL) {
+                    memcpy(data, &weights[0], size);
+                    glUnmapBuffer(GL_ARRAY_BUFFER);
+                }
+
+                fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+
+            for (segment = 0; segment < UPLOAD_RING_SEGMENTS; segment++) {
+                if (fences[segment] != 0)
+                    glDeleteSync(fences[segment]);
+            }
+
+            // Finishing would only block on the same stuck GPU
+            if (stalled)
+                runner.Fail("fence wait timed out");
+            else
+                glFinish();
+        });
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    return true;
+}
@@ -0,0 +1,690 @@
+#include "rasterizer.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
+
+#define SUBPIXEL_SCALE              (1 << RASTER_SUBPIXEL_BITS)
+#define SUBPIXEL_HALF               (SUBPIXEL_SCALE / 2)
+
+// Clip planes, as dot products with the clip-space position. The outcode of
+// a vertex has bit i set when it is outside plane i.
+static const float s_clip_planes[6][4] =
+{
+    {  1.0f,  0.0f,  0.0f, RASTER_GUARD_BAND },
+    { -1.0f,  0.0f,  0.0f, RASTER_GUARD_BAND },
+    {  0.0f,  1.0f,  0.0f, RASTER_GUARD_BAND },
+    {  0.0f, -1.0f,  0.0f, RASTER_GUARD_BAND },
+    {  0.0f,  0.0f,  1.0f, 1.0f },              // near
+    {  0.0f,  0.0f, -1.0f, 1.0f }               // far
+};
+
+static inline float PlaneDistance(const glm::vec4 & position, int plane)
+{
+    const float * p = s_clip_planes[plane];
+
+    return p[0] * position.x + p[1] * position.y + p[2] * position.z + p[3] * position.w;
+}
+
+static inline unsigned int ComputeOutcode(const glm::vec4 & position)
+{
+    unsigned int outcode = 0;
+    int plane;
+
+    for (plane = 0; plane < 6; plane++) {
+        if (PlaneDistance(position, plane) < 0.0f)
+            outcode |= 1 << plane;
+    }
+
+    return outcode;
+}
+
+// Rounds towards negative infinity, unlike integer division
+static inline int FloorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+Framebuffer::Framebuffer(void)
+    : m_width(0),
+      m_height(0),
+      m_tiles_x(0),
+      m_tiles_y(0)
+{
+
+}
+
+void Framebuffer::Create(unsigned int width, unsigned int height)
+{
+    m_width = width;
+    m_height = height;
+    m_tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    m_tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+    m_color.resize(m_tiles_x * m_tiles_y * RASTER_TILE_SIZE * RASTER_TILE_SIZE);
+    m_depth.resize(m_color.size());
+}
+
+void Framebuffer::Clear(unsigned int color, float depth)
+{
+    std::fill(m_color.begin(), m_color.end(), color);
+    std::fill(m_depth.begin(), m_depth.end(), depth);
+}
+
+void Framebuffer::ReadPixels(unsigned int * pixels) const
+{
+    unsigned int x, y;
+
+    for (y = 0; y < m_height; y++) {
+        const unsigned int * row = &m_color[((y / RASTER_TILE_SIZE) * m_tiles_x * RASTER_TILE_SIZE + (y % RASTER_TILE_SIZE)) * RASTER_TILE_SIZE];
+
+        for (x = 0; x < m_width; x += RASTER_TILE_SIZE) {
+            unsigned int count = m_width - x < RASTER_TILE_SIZE ? m_width - x : RASTER_TILE_SIZE;
+
+            memcpy(pixels + y * m_width + x, row + x * RASTER_TILE_SIZE, count * sizeof(unsigned int));
+        }
+    }
+}
+
+Rasterizer::Rasterizer(void)
+    : m_thread_count(1),
+      m_threads(1),
+      m_phase(PHASE_TRANSFORM),
+      m_generation(0),
+      m_pending(0),
+      m_quit(false),
+      m_next_tile(0),
+      m_positions(0),
+      m_normals(0),
+      m_vertex_count(0),
+      m_indices(0),
+      m_index_count(0),
+      m_framebuffer(0),
+      m_projection_matrix(0),
+      m_model_matrix(0),
+      m_weights(0),
+      m_colors(0),
+      m_width(0),
+      m_height(0),
+      m_tiles_x(0),
+      m_batch_first(0),
+      m_batch_count(0)
+{
+    ResetStats();
+}
+
+Rasterizer::~Rasterizer(void)
+{
+    StopWorkers();
+}
+
+void Rasterizer::SetThreadCount(unsigned int count)
+{
+    StopWorkers();
+
+    m_thread_count = count > 0 ? count : 1;
+    m_threads.clear();
+    m_threads.resize(m_thread_count);
+
+    StartWorkers();
+}
+
+void Rasterizer::StartWorkers(void)
+{
+    unsigned int generation;
+    unsigned int i;
+
+    // New workers must only wake for phases run after they were started,
+    // not for the last one the previous pool finished
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = false;
+        generation = m_generation;
+    }
+
+    for (i = 1; i < m_thread_count; i++)
+        m_workers.push_back(std::thread(&Rasterizer::WorkerThread, this, i, generation));
+}
+
+void Rasterizer::StopWorkers(void)
+{
+    unsigned int i;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_work_ready.notify_all();
+
+    for (i = 0; i < m_workers.size(); i++)
+        m_workers[i].join();
+    m_workers.clear();
+}
+
+void Rasterizer::WorkerThread(unsigned int thread, unsigned int generation)
+{
+    for (;;) {
+        Phase phase;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while (m_generation == generation && !m_quit)
+                m_work_ready.wait(lock);
+
+            if (m_quit)
+                break;
+
+            generation = m_generation;
+            phase = m_phase;
+        }
+
+        DoPhase(phase, thread);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (--m_pending == 0)
+            m_work_done.notify_one();
+    }
+}
+
+// Runs a phase on every thread, this one included, and returns once they
+// have all finished it
+void Rasterizer::RunPhase(Phase phase)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_phase = phase;
+        m_pending = (unsigned int)m_workers.size();
+        m_generation++;
+    }
+    m_work_ready.notify_all();
+
+    DoPhase(phase, 0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_pending != 0)
+        m_work_done.wait(lock);
+}
+
+void Rasterizer::DoPhase(Phase phase, unsigned int thread)
+{
+    ThreadState & state = m_threads[thread];
+    unsigned int i;
+
+    if (phase == PHASE_TRANSFORM) {
+        unsigned int begin = m_batch_first + m_batch_count * thread / m_thread_count;
+        unsigned int end = m_batch_first + m_batch_count * (thread + 1) / m_thread_count;
+
+        state.triangles.clear();
+        for (i = 0; i < state.touched.size(); i++)
+            state.bins[state.touched[i]].clear();
+        state.touched.clear();
+
+        TransformInstances(state, *m_projection_matrix, m_model_matrix, m_weights, begin, end - begin);
+    } else {
+        const unsigned int count = (unsigned int)m_active_tiles.size();
+
+        while ((i = m_next_tile++) < count)
+            RasterizeTile(state, m_active_tiles[i]);
+    }
+}
+
+void Rasterizer::SetMesh(const glm::vec4 * positions,
+                         const glm::vec3 * normals,
+                         unsigned int vertex_count,
+                         const unsigned int * indices,
+                         unsigned int index_count)
+{
+    m_positions = positions;
+    m_normals = normals;
+    m_vertex_count = vertex_count;
+    m_indices = indices;
+    m_index_count = index_count - index_count % 3;
+}
+
+void Rasterizer::ResetStats(void)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void Rasterizer::DrawInstanced(Framebuffer & framebuffer,
+                               const glm::mat4 & projection_matrix,
+                               const glm::mat4 model_matrix[4],
+                               const glm::vec4 * weights,
+                               const glm::vec4 * colors,
+                               unsigned int instances)
+{
+    const unsigned int batch = RASTER_BATCH_INSTANCES * m_thread_count;
+    const unsigned int tile_count = framebuffer.GetTilesX() * framebuffer.GetTilesY();
+    unsigned int first, t, i;
+
+    m_framebuffer = &framebuffer;
+    m_projection_matrix = &projection_matrix;
+    m_model_matrix = model_matrix;
+    m_weights = weights;
+    m_colors = colors;
+    m_width = (int)framebuffer.GetWidth();
+    m_height = (int)framebuffer.GetHeight();
+    m_tiles_x = framebuffer.GetTilesX();
+
+    for (t = 0; t < m_thread_count; t++) {
+        ThreadState & state = m_threads[t];
+
+        if (state.bins.size() != tile_count) {
+            state.bins.clear();
+            state.bins.resize(tile_count);
+            state.touched.clear();
+        }
+        state.triangles_drawn = 0;
+        state.pixels = 0;
+    }
+    m_tile_active.assign(tile_count, 0);
+
+    // Each batch of instances is split into contiguous ranges, one per
+    // thread, and every thread bins into its own lists. Walking the lists
+    // in thread order while rasterizing then keeps triangles in submission
+    // order within each tile, as GL would draw them.
+    for (first = 0; first < instances; first += batch) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        m_batch_first = first;
+        m_batch_count = instances - first < batch ? instances - first : batch;
+        RunPhase(PHASE_TRANSFORM);
+
+        // Only tiles something was binned to are visited
+        m_active_tiles.clear();
+        for (t = 0; t < m_thread_count; t++) {
+            const std::vector<unsigned int> & touched = m_threads[t].touched;
+
+            for (i = 0; i < touched.size(); i++) {
+                if (!m_tile_active[touched[i]]) {
+                    m_tile_active[touched[i]] = 1;
+                    m_active_tiles.push_back(touched[i]);
+                }
+            }
+        }
+        for (i = 0; i < m_active_tiles.size(); i++)
+            m_tile_active[m_active_tiles[i]] = 0;
+
+        std::chrono::steady_clock::time_point binned = std::chrono::steady_clock::now();
+
+        m_next_tile = 0;
+        RunPhase(PHASE_RASTERIZE);
+
+        std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+
+        m_stats.vertex_ms += std::chrono::duration<double, std::milli>(binned - start).count();
+        m_stats.pixel_ms += std::chrono::duration<double, std::milli>(done - binned).count();
+    }
+
+    m_stats.triangles += (unsigned long long)instances * (m_index_count / 3);
+    for (t = 0; t < m_thread_count; t++) {
+        m_stats.triangles_drawn += m_threads[t].triangles_drawn;
+        m_stats.pixels += m_threads[t].pixels;
+    }
+}
+
+void Rasterizer::TransformInstances(ThreadState & state,
+                                    const glm::mat4 & projection_matrix,
+                                    const glm::mat4 model_matrix[4],
+                                    const glm::vec4 * weights,
+                                    unsigned int first,
+                                    unsigned int count)
+{
+    unsigned int i, v;
+    int n;
+
+    state.vertices.resize(m_vertex_count);
+
+    for (i = first; i < first + count; i++) {
+        // Same operations, in the same order, as render.vs.glsl
+        glm::vec4 w = glm::normalize(weights[i]);
+        glm::mat4 m(0.0f);
+
+        for (n = 0; n < 4; n++)
+            m += model_matrix[n] * w[n];
+
+        for (v = 0; v < m_vertex_count; v++) {
+            TransformedVertex & out = state.vertices[v];
+
+            out.vertex.position = projection_matrix * (m * m_positions[v]);
+            out.vertex.normal_z = glm::normalize(glm::vec3(m * glm::vec4(m_normals[v], 0.0f))).z;
+            out.outcode = ComputeOutcode(out.vertex.position);
+        }
+
+        for (v = 0; v < m_index_count; v += 3) {
+            const TransformedVertex * tri[3] = {
+                &state.vertices[m_indices[v]],
+                &state.vertices[m_indices[v + 1]],
+                &state.vertices[m_indices[v + 2]]
+            };
+
+            if ((tri[0]->outcode | tri[1]->outcode | tri[2]->outcode) == 0)
+                SetupTriangle(state, tri[0]->vertex, tri[1]->vertex, tri[2]->vertex, i);
+            else if ((tri[0]->outcode & tri[1]->outcode & tri[2]->outcode) == 0)
+                ClipTriangle(state, tri, i);
+        }
+    }
+}
+
+void Rasterizer::ClipTriangle(ThreadState & state, const TransformedVertex * v[3], unsigned int instance)
+{
+    // Each plane can add at most one vertex to the polygon
+    ClipVertex buffer[2][3 + 6];
+    ClipVertex * in = buffer[0];
+    ClipVertex * out = buffer[1];
+    unsigned int outcode = v[0]->outcode | v[1]->outcode | v[2]->outcode;
+    int in_count = 3;
+    int plane, i;
+
+    for (i = 0; i < 3; i++)
+        in[i] = v[i]->vertex;
+
+    for (plane = 0; plane < 6 && in_count >= 3; plane++) {
+        int out_count = 0;
+
+        if ((outcode & (1 << plane)) == 0)
+            continue;
+
+        for (i = 0; i < in_count; i++) {
+            const ClipVertex & a = in[i];
+            const ClipVertex & b = in[(i + 1) % in_count];
+            float da = PlaneDistance(a.position, plane);
+            float db = PlaneDistance(b.position, plane);
+
+            if (da >= 0.0f)
+                out[out_count++] = a;
+
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da / (da - db);
+
+                out[out_count].position = a.position + (b.position - a.position) * t;
+                out[out_count].normal_z = a.normal_z + (b.normal_z - a.normal_z) * t;
+                out_count++;
+            }
+        }
+
+        ClipVertex * temp = in;
+        in = out;
+        out = temp;
+        in_count = out_count;
+    }
+
+    for (i = 1; i + 1 < in_count; i++)
+        SetupTriangle(state, in[0], in[i], in[i + 1], instance);
+}
+
+void Rasterizer::SetupTriangle(ThreadState & state, const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2, unsigned int instance)
+{
+    const ClipVertex * v[3] = { &v0, &v1, &v2 };
+    Triangle tri;
+    float z[3];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        float inv_w = 1.0f / v[i]->position.w;
+        float x = (v[i]->position.x * inv_w * 0.5f + 0.5f) * m_width;
+        float y = (v[i]->position.y * inv_w * 0.5f + 0.5f) * m_height;
+
+        tri.x[i] = (int)floorf(x * SUBPIXEL_SCALE + 0.5f);
+        tri.y[i] = (int)floorf(y * SUBPIXEL_SCALE + 0.5f);
+        tri.inv_w[i] = inv_w;
+        tri.normal_z[i] = v[i]->normal_z * inv_w;
+        z[i] = v[i]->position.z * inv_w * 0.5f + 0.5f;
+    }
+
+    // Counter-clockwise triangles have positive area with y pointing up;
+    // everything else is back facing (or has no area) and is culled
+    long long dx1 = tri.x[1] - tri.x[0];
+    long long dy1 = tri.y[1] - tri.y[0];
+    long long dx2 = tri.x[2] - tri.x[0];
+    long long dy2 = tri.y[2] - tri.y[0];
+    long long area = dx1 * dy2 - dx2 * dy1;
+
+    if (area <= 0)
+        return;
+
+    // Pixels whose centers may be covered, clipped to the viewport
+    int min_x = tri.x[0] < tri.x[1] ? tri.x[0] : tri.x[1];
+    int max_x = tri.x[0] > tri.x[1] ? tri.x[0] : tri.x[1];
+    int min_y = tri.y[0] < tri.y[1] ? tri.y[0] : tri.y[1];
+    int max_y = tri.y[0] > tri.y[1] ? tri.y[0] : tri.y[1];
+
+    min_x = min_x < tri.x[2] ? min_x : tri.x[2];
+    max_x = max_x > tri.x[2] ? max_x : tri.x[2];
+    min_y = min_y < tri.y[2] ? min_y : tri.y[2];
+    max_y = max_y > tri.y[2] ? max_y : tri.y[2];
+
+    tri.min_x = FloorDiv(min_x - SUBPIXEL_HALF + SUBPIXEL_SCALE - 1, SUBPIXEL_SCALE);
+    tri.max_x = FloorDiv(max_x - SUBPIXEL_HALF, SUBPIXEL_SCALE);
+    tri.min_y = FloorDiv(min_y - SUBPIXEL_HALF + SUBPIXEL_SCALE - 1, SUBPIXEL_SCALE);
+    tri.max_y = FloorDiv(max_y - SUBPIXEL_HALF, SUBPIXEL_SCALE);
+
+    if (tri.min_x < 0)
+        tri.min_x = 0;
+    if (tri.min_y < 0)
+        tri.min_y = 0;
+    if (tri.max_x > m_width - 1)
+        tri.max_x = m_width - 1;
+    if (tri.max_y > m_height - 1)
+        tri.max_y = m_height - 1;
+
+    if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+        return;
+
+    // Attribute planes, from the snapped positions so that they agree with
+    // the edge functions
+    double scale = 1.0 / SUBPIXEL_SCALE;
+    double fdx1 = dx1 * scale, fdy1 = dy1 * scale;
+    double fdx2 = dx2 * scale, fdy2 = dy2 * scale;
+    double inv_area = 1.0 / (area * scale * scale);
+    float * planes[3] = { tri.z, tri.inv_w, tri.normal_z };
+    float values[3][3] = {
+        { z[0], z[1], z[2] },
+        { tri.inv_w[0], tri.inv_w[1], tri.inv_w[2] },
+        { tri.normal_z[0], tri.normal_z[1], tri.normal_z[2] }
+    };
+
+    for (i = 0; i < 3; i++) {
+        double da1 = (double)values[i][1] - values[i][0];
+        double da2 = (double)values[i][2] - values[i][0];
+
+        planes[i][0] = values[i][0];
+        planes[i][1] = (float)((da1 * fdy2 - da2 * fdy1) * inv_area);
+        planes[i][2] = (float)((da2 * fdx1 - da1 * fdx2) * inv_area);
+    }
+
+    tri.origin_x = (float)(tri.x[0] * scale);
+    tri.origin_y = (float)(tri.y[0] * scale);
+    tri.instance = instance;
+
+    unsigned int index = (unsigned int)state.triangles.size();
+    int tile_x, tile_y;
+
+    state.triangles.push_back(tri);
+    state.triangles_drawn++;
+
+    for (tile_y = tri.min_y / RASTER_TILE_SIZE; tile_y <= tri.max_y / RASTER_TILE_SIZE; tile_y++) {
+        for (tile_x = tri.min_x / RASTER_TILE_SIZE; tile_x <= tri.max_x / RASTER_TILE_SIZE; tile_x++) {
+            unsigned int tile = tile_y * m_tiles_x + tile_x;
+
+            if (state.bins[tile].empty())
+                state.touched.push_back(tile);
+            state.bins[tile].push_back(index);
+        }
+    }
+}
+
+void Rasterizer::RasterizeTile(ThreadState & state, unsigned int tile)
+{
+    unsigned int tile_x = tile % m_tiles_x;
+    unsigned int tile_y = tile / m_tiles_x;
+    unsigned int * color = m_framebuffer->GetTileColor(tile);
+    float * depth = m_framebuffer->GetTileDepth(tile);
+    unsigned int t, i;
+
+    for (t = 0; t < m_thread_count; t++) {
+        const ThreadState & source = m_threads[t];
+        const std::vector<unsigned int> & bin = source.bins[tile];
+
+        for (i = 0; i < bin.size(); i++)
+            RasterizeTriangle(state, source.triangles[bin[i]], tile_x, tile_y, color, depth);
+    }
+}
+
+void Rasterizer::RasterizeTriangle(ThreadState & state, const Triangle & tri, unsigned int tile_x, unsigned int tile_y,
+                                   unsigned int * color, float * depth)
+{
+    const int tile_x0 = tile_x * RASTER_TILE_SIZE;
+    const int tile_y0 = tile_y * RASTER_TILE_SIZE;
+    int x0 = tri.min_x > tile_x0 ? tri.min_x : tile_x0;
+    int y0 = tri.min_y > tile_y0 ? tri.min_y : tile_y0;
+    int x1 = tri.max_x < tile_x0 + RASTER_TILE_SIZE - 1 ? tri.max_x : tile_x0 + RASTER_TILE_SIZE - 1;
+    int y1 = tri.max_y < tile_y0 + RASTER_TILE_SIZE - 1 ? tri.max_y : tile_y0 + RASTER_TILE_SIZE - 1;
+    int x, y, i;
+
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // Pixels are processed four at a time, in groups aligned within the
+    // tile (which has room for the overhang at the right of the viewport).
+    // Overhanging lanes are masked out below.
+    x0 &= ~3;
+    x1 |= 3;
+
+    __m128i row[3];
+    __m128i step_x[3];
+    __m128i step_y[3];
+
+    for (i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        long long a = tri.y[i] - tri.y[j];
+        long long b = tri.x[j] - tri.x[i];
+
+        // Top-left rule: with y up and counter-clockwise winding, left edges
+        // run downwards and top edges run to the left. Pixels exactly on
+        // any other edge belong to the neighbouring triangle.
+        bool top_left = tri.y[j] < tri.y[i] || (tri.y[j] == tri.y[i] && tri.x[j] < tri.x[i]);
+        long long bias = top_left ? 0 : -1;
+        long long e00 = a * (x0 * SUBPIXEL_SCALE + SUBPIXEL_HALF - tri.x[i]) + b * (y0 * SUBPIXEL_SCALE + SUBPIXEL_HALF - tri.y[i]) + bias;
+        long long e10 = e00 + a * (x1 - x0) * SUBPIXEL_SCALE;
+        long long e01 = e00 + b * (y1 - y0) * SUBPIXEL_SCALE;
+        long long e11 = e10 + b * (y1 - y0) * SUBPIXEL_SCALE;
+
+        // An edge that the rectangle is entirely outside of rejects the
+        // triangle, and one it is entirely inside of needn't be tested. Only
+        // edges crossing the rectangle are stepped, and those values are
+        // bounded by the rectangle's size so they fit in 32 bits.
+        if (e00 < 0 && e10 < 0 && e01 < 0 && e11 < 0)
+            return;
+
+        if (e00 >= 0 && e10 >= 0 && e01 >= 0 && e11 >= 0) {
+            row[i] = _mm_setzero_si128();
+            step_x[i] = _mm_setzero_si128();
+            step_y[i] = _mm_setzero_si128();
+        } else {
+            int sx = (int)(a * SUBPIXEL_SCALE);
+
+            row[i] = _mm_setr_epi32((int)e00, (int)e00 + sx, (int)e00 + sx * 2, (int)e00 + sx * 3);
+            step_x[i] = _mm_set1_epi32(sx * 4);
+            step_y[i] = _mm_set1_epi32((int)(b * SUBPIXEL_SCALE));
+        }
+    }
+
+    const glm::vec4 & c = m_colors[tri.instance];
+    const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 ambient = _mm_set1_ps(0.1f);
+    const __m128 to_byte = _mm_set1_ps(255.0f);
+    const __m128 color_r = _mm_set1_ps(c.x);
+    const __m128 color_g = _mm_set1_ps(c.y);
+    const __m128 color_b = _mm_set1_ps(c.z);
+    const __m128 color_a = _mm_set1_ps(c.w);
+    const __m128 highlight_r = _mm_set1_ps(0.8f);
+    const __m128 highlight_g = _mm_set1_ps(0.9f);
+    const __m128 highlight_b = _mm_set1_ps(0.7f);
+    const __m128 z_dx = _mm_set1_ps(tri.z[1]);
+    const __m128 inv_w_dx = _mm_set1_ps(tri.inv_w[1]);
+    const __m128 normal_z_dx = _mm_set1_ps(tri.normal_z[1]);
+    const __m128i minus_one = _mm_set1_epi32(-1);
+    const __m128i lane_x = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i width = _mm_set1_epi32(m_width);
+    unsigned long long pixels = 0;
+
+    for (y = y0; y <= y1; y++) {
+        __m128i e0 = row[0];
+        __m128i e1 = row[1];
+        __m128i e2 = row[2];
+        float fy = (float)y + 0.5f - tri.origin_y;
+        __m128 z_row = _mm_set1_ps(tri.z[0] + tri.z[2] * fy);
+        __m128 inv_w_row = _mm_set1_ps(tri.inv_w[0] + tri.inv_w[2] * fy);
+        __m128 normal_z_row = _mm_set1_ps(tri.normal_z[0] + tri.normal_z[2] * fy);
+        unsigned int * color_row = color + (y - tile_y0) * RASTER_TILE_SIZE - tile_x0;
+        float * depth_row = depth + (y - tile_y0) * RASTER_TILE_SIZE - tile_x0;
+
+        for (x = x0; x <= x1; x += 4) {
+            __m128i edges = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+
+            if (_mm_movemask_ps(_mm_castsi128_ps(edges)) != 0xF) {
+                __m128 fx = _mm_add_ps(_mm_set1_ps((float)x - tri.origin_x), lane);
+                __m128 z = _mm_add_ps(z_row, _mm_mul_ps(z_dx, fx));
+                __m128 old_z = _mm_loadu_ps(depth_row + x);
+                __m128i inside = _mm_and_si128(_mm_cmpgt_epi32(edges, minus_one),
+                                               _mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(x), lane_x), width));
+                __m128 pass = _mm_and_ps(_mm_castsi128_ps(inside), _mm_cmple_ps(z, old_z));
+                int mask = _mm_movemask_ps(pass);
+
+                if (mask) {
+                    __m128 inv_w = _mm_add_ps(inv_w_row, _mm_mul_ps(inv_w_dx, fx));
+                    __m128 normal_z = _mm_add_ps(normal_z_row, _mm_mul_ps(normal_z_dx, fx));
+
+                    // render.fs.glsl: color * (0.1 + |n.z|) + highlight * |n.z|^40
+                    __m128 nz = _mm_and_ps(_mm_div_ps(normal_z, inv_w), abs_mask);
+                    __m128 nz2 = _mm_mul_ps(nz, nz);
+                    __m128 nz4 = _mm_mul_ps(nz2, nz2);
+                    __m128 nz8 = _mm_mul_ps(nz4, nz4);
+                    __m128 nz16 = _mm_mul_ps(nz8, nz8);
+                    __m128 nz32 = _mm_mul_ps(nz16, nz16);
+                    __m128 specular = _mm_mul_ps(nz32, nz8);
+                    __m128 diffuse = _mm_add_ps(ambient, nz);
+                    __m128 r = _mm_add_ps(_mm_mul_ps(color_r, diffuse), _mm_mul_ps(highlight_r, specular));
+                    __m128 g = _mm_add_ps(_mm_mul_ps(color_g, diffuse), _mm_mul_ps(highlight_g, specular));
+                    __m128 b = _mm_add_ps(_mm_mul_ps(color_b, diffuse), _mm_mul_ps(highlight_b, specular));
+                    __m128 a = _mm_add_ps(_mm_mul_ps(color_a, diffuse), specular);
+
+                    // Clamp and round to 8 bits per channel, as a UNORM8
+                    // color buffer would
+                    r = _mm_mul_ps(_mm_min_ps(_mm_max_ps(r, zero), one), to_byte);
+                    g = _mm_mul_ps(_mm_min_ps(_mm_max_ps(g, zero), one), to_byte);
+                    b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(b, zero), one), to_byte);
+                    a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(a, zero), one), to_byte);
+
+                    __m128i rgba = _mm_or_si128(_mm_or_si128(_mm_cvtps_epi32(r), _mm_slli_epi32(_mm_cvtps_epi32(g), 8)),
+                                                _mm_or_si128(_mm_slli_epi32(_mm_cvtps_epi32(b), 16), _mm_slli_epi32(_mm_cvtps_epi32(a), 24)));
+                    __m128i pass_i = _mm_castps_si128(pass);
+                    __m128i old_color = _mm_loadu_si128((const __m128i *)(color_row + x));
+
+                    _mm_storeu_ps(depth_row + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old_z)));
+                    _mm_storeu_si128((__m128i *)(color_row + x), _mm_or_si128(_mm_and_si128(pass_i, rgba), _mm_andnot_si128(pass_i, old_color)));
+
+                    pixels += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+                }
+            }
+
+            e0 = _mm_add_epi32(e0, step_x[0]);
+            e1 = _mm_add_epi32(e1, step_x[1]);
+            e2 = _mm_add_epi32(e2, step_x[2]);
+        }
+
+        row[0] = _mm_add_epi32(row[0], step_y[0]);
+        row[1] = _mm_add_epi32(row[1], step_y[1]);
+        row[2] = _mm_add_epi32(row[2], step_y[2]);
+    }
+
+    state.pixels += pixels;
+}
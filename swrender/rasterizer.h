@@ -0,0 +1,234 @@
+#ifndef __RASTERIZER_H__
+#define __RASTERIZER_H__
+
+// Software implementation of the sample's instanced draw. The vertex stage
+// mirrors render.vs.glsl (weighted blend of the four model matrices, normal
+// transform) and the pixel stage mirrors render.fs.glsl. Rasterization
+// follows the usual GL rules: counter-clockwise front faces with back faces
+// culled, pixel centers at half integers, a top-left fill convention and a
+// GL_LEQUAL depth test (what the sample's shading pass uses).
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The framebuffer is stored in square tiles so that a tile's color and
+// depth stay in cache while it is rasterized, and tiles can be handed out
+// to threads independently
+#define RASTER_TILE_SIZE            64
+
+// Instances transformed and binned per thread before the tiles are
+// rasterized. This bounds the memory used by binned triangles.
+#define RASTER_BATCH_INSTANCES      4
+
+// Triangles are clipped against a guard band this many times the size of
+// the viewport, which keeps snapped window coordinates comfortably within
+// the range of the integer edge functions
+#define RASTER_GUARD_BAND           2.0f
+
+// Number of sub-pixel bits window coordinates are snapped to
+#define RASTER_SUBPIXEL_BITS        4
+
+class Framebuffer
+{
+public:
+    Framebuffer(void);
+
+    void Create(unsigned int width, unsigned int height);
+    void Clear(unsigned int color, float depth);
+
+    // Copies the color buffer out in rows of RGBA8 pixels, bottom row first
+    // (the same layout glReadPixels produces)
+    void ReadPixels(unsigned int * pixels) const;
+
+    unsigned int GetWidth(void) const
+    {
+        return m_width;
+    }
+
+    unsigned int GetHeight(void) const
+    {
+        return m_height;
+    }
+
+    unsigned int GetTilesX(void) const
+    {
+        return m_tiles_x;
+    }
+
+    unsigned int GetTilesY(void) const
+    {
+        return m_tiles_y;
+    }
+
+    unsigned int * GetTileColor(unsigned int tile)
+    {
+        return &m_color[tile * RASTER_TILE_SIZE * RASTER_TILE_SIZE];
+    }
+
+    float * GetTileDepth(unsigned int tile)
+    {
+        return &m_depth[tile * RASTER_TILE_SIZE * RASTER_TILE_SIZE];
+    }
+
+protected:
+    unsigned int m_width;
+    unsigned int m_height;
+    unsigned int m_tiles_x;
+    unsigned int m_tiles_y;
+    std::vector<unsigned int> m_color;
+    std::vector<float> m_depth;
+};
+
+typedef struct RASTER_STATS_t
+{
+    unsigned long long triangles;           // submitted
+    unsigned long long triangles_drawn;     // left after clipping and culling
+    unsigned long long pixels;              // passed the depth test
+    double vertex_ms;                       // transform, clip, setup and binning
+    double pixel_ms;                        // tile rasterization and shading
+} RASTER_STATS;
+
+class Rasterizer
+{
+public:
+    Rasterizer(void);
+    ~Rasterizer(void);
+
+    // Starts count - 1 worker threads, which are kept for every draw; the
+    // calling thread does its share of the work too
+    void SetThreadCount(unsigned int count);
+
+    // The mesh is an indexed triangle list. Positions have four components
+    // and normals three; the arrays must stay valid while drawing.
+    void SetMesh(const glm::vec4 * positions,
+                 const glm::vec3 * normals,
+                 unsigned int vertex_count,
+                 const unsigned int * indices,
+                 unsigned int index_count);
+
+    void DrawInstanced(Framebuffer & framebuffer,
+                       const glm::mat4 & projection_matrix,
+                       const glm::mat4 model_matrix[4],
+                       const glm::vec4 * weights,
+                       const glm::vec4 * colors,
+                       unsigned int instances);
+
+    void ResetStats(void);
+
+    const RASTER_STATS & GetStats(void) const
+    {
+        return m_stats;
+    }
+
+protected:
+    struct ClipVertex
+    {
+        glm::vec4 position;
+        float normal_z;
+    };
+
+    struct TransformedVertex
+    {
+        ClipVertex vertex;
+        unsigned int outcode;
+    };
+
+    // Window coordinates are snapped to fixed point for the edge functions.
+    // Depth, 1/w and normal.z/w vary linearly in window space and are
+    // stored as planes relative to the first vertex.
+    struct Triangle
+    {
+        int x[3];
+        int y[3];
+        int min_x;
+        int min_y;
+        int max_x;
+        int max_y;
+        float origin_x;
+        float origin_y;
+        float z[3];                 // value at the origin, d/dx, d/dy
+        float inv_w[3];
+        float normal_z[3];          // normal.z / w
+        unsigned int instance;
+    };
+
+    struct ThreadState
+    {
+        std::vector<TransformedVertex> vertices;
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<unsigned int> > bins;
+        std::vector<unsigned int> touched;      // tiles with a non-empty bin
+        unsigned long long triangles_drawn;
+        unsigned long long pixels;
+    };
+
+    // Work handed to all threads at once by RunPhase()
+    enum Phase
+    {
+        PHASE_TRANSFORM,
+        PHASE_RASTERIZE
+    };
+
+    void StartWorkers(void);
+    void StopWorkers(void);
+    void WorkerThread(unsigned int thread, unsigned int generation);
+    void RunPhase(Phase phase);
+    void DoPhase(Phase phase, unsigned int thread);
+
+    void TransformInstances(ThreadState & state,
+                            const glm::mat4 & projection_matrix,
+                            const glm::mat4 model_matrix[4],
+                            const glm::vec4 * weights,
+                            unsigned int first,
+                            unsigned int count);
+    void ClipTriangle(ThreadState & state, const TransformedVertex * v[3], unsigned int instance);
+    void SetupTriangle(ThreadState & state, const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2, unsigned int instance);
+    void RasterizeTile(ThreadState & state, unsigned int tile);
+    void RasterizeTriangle(ThreadState & state, const Triangle & tri, unsigned int tile_x, unsigned int tile_y,
+                           unsigned int * color, float * depth);
+
+    unsigned int m_thread_count;
+    std::vector<ThreadState> m_threads;
+
+    // Worker pool. Each RunPhase() bumps the generation, which wakes the
+    // workers, and waits for pending to drop back to zero.
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_work_ready;
+    std::condition_variable m_work_done;
+    Phase m_phase;
+    unsigned int m_generation;
+    unsigned int m_pending;
+    bool m_quit;
+
+    // Tiles any thread binned triangles to in the current batch
+    std::vector<unsigned int> m_active_tiles;
+    std::vector<unsigned char> m_tile_active;
+    std::atomic<unsigned int> m_next_tile;
+
+    const glm::vec4 * m_positions;
+    const glm::vec3 * m_normals;
+    unsigned int m_vertex_count;
+    const unsigned int * m_indices;
+    unsigned int m_index_count;
+
+    // Per draw: target, scene, viewport size and the current batch
+    Framebuffer * m_framebuffer;
+    const glm::mat4 * m_projection_matrix;
+    const glm::mat4 * m_model_matrix;
+    const glm::vec4 * m_weights;
+    const glm::vec4 * m_colors;
+    int m_width;
+    int m_height;
+    unsigned int m_tiles_x;
+    unsigned int m_batch_first;
+    unsigned int m_batch_count;
+
+    RASTER_STATS m_stats;
+};
+
+#endif /* __RASTERIZER_H__ */
@@ -0,0 +1,346 @@
+// swrender - renders the instancing sample's scene on the CPU
+//
+// This runs the same scene as 03-instancing (see scene.h) through a
+// software implementation of its shaders, so that the instancing path can
+// be checked and timed on machines without a GPU. The frame is written out
+// as a PPM image and can be compared against a golden image; the exit code
+// is non-zero if they differ.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#define VBM_FILE_TYPES_ONLY
+#include "vbm.h"
+#include "scene.h"
+#include "rasterizer.h"
+
+#ifndef GL_UNSIGNED_SHORT
+#define GL_UNSIGNED_SHORT           0x1403
+#endif
+
+// Limit of the integer edge functions (see RASTER_GUARD_BAND)
+#define MAX_VIEWPORT_SIZE           8192
+
+static void Usage(void)
+{
+    printf("Usage: swrender [options] model.vbm\n"
+           "\n"
+           "Options:\n"
+           "  -w W, -h H       framebuffer size (default 800x600, like the sample)\n"
+           "  -time MS         scene time in milliseconds since startup (default 0)\n"
+           "  -frames N        number of times to render the frame, for timing\n"
+           "  -threads N       number of threads (default: all cores)\n"
+           "  -o FILE          write the frame to FILE as a PPM image\n"
+           "  -golden FILE     compare the frame against a PPM image\n"
+           "  -tolerance N     largest per-channel difference that still matches\n"
+           "                   (default 2)\n"
+           "  -max-errors N    number of mismatching pixels allowed (default 0)\n");
+}
+
+// Builds an indexed triangle list for frame 0. Only the vertices the frame
+// references are kept, so each is transformed once per instance just as
+// the vertex shader would run.
+static bool LoadMesh(const char * filename,
+                     std::vector<glm::vec4> & positions,
+                     std::vector<glm::vec3> & normals,
+                     std::vector<unsigned int> & indices)
+{
+    FILE * f = fopen(filename, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: unable to open file\n", filename);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size_t filesize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    std::vector<unsigned char> data(filesize);
+    size_t read = filesize ? fread(&data[0], filesize, 1, f) : 0;
+    fclose(f);
+
+    VBM_FILE file;
+
+    if (read != 1 || !ParseVBM(&data[0], filesize, &file)) {
+        fprintf(stderr, "%s: not a valid VBM file\n", filename);
+        return false;
+    }
+
+    if (file.header.num_attribs < 2 || file.header.num_frames == 0 ||
+        file.attribs[0].components < 3 || file.attribs[0].components > 4 ||
+        file.attribs[1].components != 3) {
+        fprintf(stderr, "%s: expected position and normal attributes\n", filename);
+        return false;
+    }
+
+    const unsigned int vertex_count = file.header.num_vertices;
+    const unsigned int position_components = file.attribs[0].components;
+    const float * position_data = (const float *)file.vertex_data;
+    const float * normal_data = position_data + position_components * vertex_count;
+    const VBM_FRAME_HEADER & frame = file.frames[0];
+    std::vector<unsigned int> remap(vertex_count, ~0u);
+    unsigned int i;
+
+    for (i = 0; i < frame.count; i++) {
+        unsigned int element = frame.first + i;
+        unsigned int vertex;
+
+        if (file.header.num_indices == 0)
+            vertex = element;
+        else if (file.header.index_type == GL_UNSIGNED_SHORT)
+            vertex = ((const unsigned short *)file.index_data)[element];
+        else
+            vertex = ((const unsigned int *)file.index_data)[element];
+
+        if (vertex >= vertex_count) {
+            fprintf(stderr, "%s: index out of range\n", filename);
+            return false;
+        }
+
+        if (remap[vertex] == ~0u) {
+            const float * p = position_data + vertex * position_components;
+            const float * n = normal_data + vertex * 3;
+
+            remap[vertex] = (unsigned int)positions.size();
+            positions.push_back(glm::vec4(p[0], p[1], p[2], position_components == 4 ? p[3] : 1.0f));
+            normals.push_back(glm::vec3(n[0], n[1], n[2]));
+        }
+
+        indices.push_back(remap[vertex]);
+    }
+
+    return true;
+}
+
+// Rows are written top to bottom, so the image is flipped relative to the
+// framebuffer
+static bool WritePPM(const char * filename, const std::vector<unsigned int> & pixels, unsigned int width, unsigned int height)
+{
+    FILE * f = fopen(filename, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: unable to create file\n", filename);
+        return false;
+    }
+
+    std::vector<unsigned char> row(width * 3);
+    unsigned int x, y;
+
+    fprintf(f, "P6\n%u %u\n255\n", width, height);
+    for (y = height; y-- > 0; ) {
+        for (x = 0; x < width; x++) {
+            unsigned int pixel = pixels[y * width + x];
+
+            row[x * 3 + 0] = pixel & 0xFF;
+            row[x * 3 + 1] = (pixel >> 8) & 0xFF;
+            row[x * 3 + 2] = (pixel >> 16) & 0xFF;
+        }
+        fwrite(&row[0], 1, row.size(), f);
+    }
+
+    bool ok = ferror(f) == 0;
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (!ok)
+        fprintf(stderr, "%s: write failed\n", filename);
+
+    return ok;
+}
+
+// Reads a binary PPM with 8 bits per channel, top row first
+static bool ReadPPM(const char * filename, std::vector<unsigned char> & rgb, unsigned int * width, unsigned int * height)
+{
+    FILE * f = fopen(filename, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: unable to open file\n", filename);
+        return false;
+    }
+
+    unsigned int max_value = 0;
+    bool ok = fscanf(f, "P6 %u %u %u", width, height, &max_value) == 3 && max_value == 255 && fgetc(f) != EOF;
+
+    if (ok) {
+        rgb.resize((size_t)*width * *height * 3);
+        ok = rgb.empty() || fread(&rgb[0], rgb.size(), 1, f) == 1;
+    }
+    fclose(f);
+
+    if (!ok)
+        fprintf(stderr, "%s: not a binary PPM image with 8 bits per channel\n", filename);
+
+    return ok;
+}
+
+// Returns the number of pixels that differ by more than tolerance in any
+// channel, or -1 if the golden image can't be used
+static long long ComparePPM(const char * filename, const std::vector<unsigned int> & pixels, unsigned int width, unsigned int height,
+                            int tolerance, int * max_difference)
+{
+    std::vector<unsigned char> golden;
+    unsigned int golden_width, golden_height;
+    long long mismatches = 0;
+    unsigned int x, y;
+    int c;
+
+    if (!ReadPPM(filename, golden, &golden_width, &golden_height))
+        return -1;
+
+    if (golden_width != width || golden_height != height) {
+        fprintf(stderr, "%s: image is %ux%u, the frame is %ux%u\n", filename, golden_width, golden_height, width, height);
+        return -1;
+    }
+
+    *max_difference = 0;
+
+    for (y = 0; y < height; y++) {
+        const unsigned char * expected = &golden[(size_t)(height - 1 - y) * width * 3];
+
+        for (x = 0; x < width; x++) {
+            unsigned int pixel = pixels[y * width + x];
+            bool mismatch = false;
+
+            for (c = 0; c < 3; c++) {
+                int difference = abs((int)((pixel >> (c * 8)) & 0xFF) - (int)expected[x * 3 + c]);
+
+                if (difference > *max_difference)
+                    *max_difference = difference;
+                if (difference > tolerance)
+                    mismatch = true;
+            }
+
+            if (mismatch)
+                mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int width = 800;
+    unsigned int height = 600;
+    unsigned int app_time = 0;
+    unsigned int frames = 1;
+    unsigned int threads = std::thread::hardware_concurrency();
+    const char * output = NULL;
+    const char * golden = NULL;
+    int tolerance = 2;
+    long long max_errors = 0;
+    int arg;
+
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (arg + 1 >= argc) {
+            Usage();
+            return 1;
+        }
+
+        if (strcmp(argv[arg], "-w") == 0) {
+            width = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-h") == 0) {
+            height = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-time") == 0) {
+            app_time = (unsigned int)strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-frames") == 0) {
+            frames = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-threads") == 0) {
+            threads = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-o") == 0) {
+            output = argv[++arg];
+        } else if (strcmp(argv[arg], "-golden") == 0) {
+            golden = argv[++arg];
+        } else if (strcmp(argv[arg], "-tolerance") == 0) {
+            tolerance = atoi(argv[++arg]);
+        } else if (strcmp(argv[arg], "-max-errors") == 0) {
+            max_errors = atoll(argv[++arg]);
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (arg + 1 != argc || width == 0 || height == 0 || width > MAX_VIEWPORT_SIZE || height > MAX_VIEWPORT_SIZE) {
+        Usage();
+        return 1;
+    }
+
+    if (frames == 0)
+        frames = 1;
+    if (threads == 0)
+        threads = 1;
+
+    std::vector<glm::vec4> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> indices;
+
+    if (!LoadMesh(argv[arg], positions, normals, indices))
+        return 1;
+
+    if (indices.size() < 3) {
+        fprintf(stderr, "%s: no triangles to draw\n", argv[arg]);
+        return 1;
+    }
+
+    // The scene, exactly as Display() sets it up
+    glm::vec4 colors[INSTANCE_COUNT];
+    glm::vec4 weights[INSTANCE_COUNT];
+    glm::mat4 model_matrix[4];
+    float t = SceneTime(app_time);
+
+    GenerateInstanceColors(colors, INSTANCE_COUNT);
+    GenerateInstanceWeights(t, weights, INSTANCE_COUNT);
+    GenerateModelMatrices(t, model_matrix);
+
+    glm::mat4 projection_matrix(GenerateProjectionMatrix(float(height) / float(width)));
+
+    Framebuffer framebuffer;
+    Rasterizer rasterizer;
+    unsigned int frame;
+
+    framebuffer.Create(width, height);
+    rasterizer.SetThreadCount(threads);
+    rasterizer.SetMesh(&positions[0], &normals[0], (unsigned int)positions.size(), &indices[0], (unsigned int)indices.size());
+
+    printf("%s: %u vertices, %u triangles, %u instances, %ux%u, %u threads\n",
+           argv[arg], (unsigned int)positions.size(), (unsigned int)indices.size() / 3, INSTANCE_COUNT, width, height, threads);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (frame = 0; frame < frames; frame++) {
+        framebuffer.Clear(0, 1.0f);
+        rasterizer.DrawInstanced(framebuffer, projection_matrix, model_matrix, weights, colors, INSTANCE_COUNT);
+    }
+
+    double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const RASTER_STATS & stats = rasterizer.GetStats();
+
+    printf("%u frames in %.1f ms (%.2f ms/frame; vertex %.2f ms, pixel %.2f ms)\n",
+           frames, total_ms, total_ms / frames, stats.vertex_ms / frames, stats.pixel_ms / frames);
+    printf("%llu triangles (%llu drawn), %llu pixels per frame\n",
+           stats.triangles / frames, stats.triangles_drawn / frames, stats.pixels / frames);
+    printf("%.2f Mtris/s, %.2f Mpixels/s\n",
+           total_ms > 0.0 ? stats.triangles / total_ms / 1000.0 : 0.0,
+           total_ms > 0.0 ? stats.pixels / total_ms / 1000.0 : 0.0);
+
+    std::vector<unsigned int> pixels(width * height);
+    framebuffer.ReadPixels(&pixels[0]);
+
+    if (output != NULL && !WritePPM(output, pixels, width, height))
+        return 1;
+
+    if (golden != NULL) {
+        int max_difference = 0;
+        long long mismatches = ComparePPM(golden, pixels, width, height, tolerance, &max_difference);
+
+        if (mismatches < 0)
+            return 1;
+
+        printf("%s: %lld pixels differ by more than %d (largest difference %d)\n", golden, mismatches, tolerance, max_difference);
+        if (mismatches > max_errors)
+            return 2;
+    }
+
+    return 0;
+}
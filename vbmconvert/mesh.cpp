@@ -0,0 +1,406 @@
+#include "mesh.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+unsigned int g_thread_count = 1;
+
+StageTimer::StageTimer(void)
+    : m_start(std::chrono::steady_clock::now()),
+      m_last(m_start)
+{
+
+}
+
+void StageTimer::Stage(const char * name)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    printf("  %-12s %9.1f ms\n", name, std::chrono::duration<double, std::milli>(now - m_last).count());
+    m_last = now;
+}
+
+double StageTimer::GetTotal(void) const
+{
+    return std::chrono::duration<double, std::milli>(m_last - m_start).count();
+}
+
+MappedFile::MappedFile(void)
+    : m_data(0),
+      m_size(0),
+#ifdef _WIN32
+      m_file(INVALID_HANDLE_VALUE),
+      m_mapping(NULL)
+#else
+      m_fd(-1)
+#endif
+{
+
+}
+
+MappedFile::~MappedFile(void)
+{
+    Close();
+}
+
+bool MappedFile::Open(const char * filename)
+{
+    Close();
+
+#ifdef _WIN32
+    m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        Close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+
+    // Zero length files can't be mapped, but are valid (empty) input
+    if (m_size == 0) {
+        m_data = "";
+        return true;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping == NULL) {
+        Close();
+        return false;
+    }
+
+    m_data = (const char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    m_fd = open(filename, O_RDONLY);
+    if (m_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        Close();
+        return false;
+    }
+    m_size = (size_t)st.st_size;
+
+    if (m_size == 0) {
+        m_data = "";
+        return true;
+    }
+
+    void * data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    m_data = data == MAP_FAILED ? NULL : (const char *)data;
+#endif
+
+    if (m_data == NULL) {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close(void)
+{
+#ifdef _WIN32
+    if (m_data && m_size)
+        UnmapViewOfFile(m_data);
+    if (m_mapping != NULL)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_data && m_size)
+        munmap((void *)m_data, m_size);
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+#endif
+    m_data = 0;
+    m_size = 0;
+}
+
+void SplitLines(const char * begin, const char * end, unsigned int count, std::vector<const char *> & bounds)
+{
+    size_t size = end - begin;
+    unsigned int i;
+
+    bounds.clear();
+    bounds.push_back(begin);
+
+    for (i = 1; i < count; i++) {
+        const char * p = begin + size * i / count;
+
+        if (p < bounds.back())
+            p = bounds.back();
+
+        p = (const char *)memchr(p, '\n', end - p);
+        p = p ? p + 1 : end;
+
+        if (p > bounds.back() && p < end)
+            bounds.push_back(p);
+    }
+
+    bounds.push_back(end);
+}
+
+static const double s_pow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+const char * ParseFloat(const char * p, const char * end, float * value)
+{
+    unsigned long long mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool negative = false;
+    bool any_digits = false;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Only the first 19 significant digits fit in the mantissa; beyond that
+    // integer digits just scale and fraction digits are dropped
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        any_digits = true;
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa)
+                significant++;
+        } else {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            any_digits = true;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa)
+                    significant++;
+                exponent--;
+            }
+        }
+    }
+
+    if (!any_digits)
+        return NULL;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char * q = p + 1;
+        bool exponent_negative = false;
+        int e = 0;
+
+        if (q < end && (*q == '-' || *q == '+')) {
+            exponent_negative = *q == '-';
+            q++;
+        }
+
+        if (q < end && *q >= '0' && *q <= '9') {
+            for (; q < end && *q >= '0' && *q <= '9'; q++) {
+                if (e < 10000)
+                    e = e * 10 + (*q - '0');
+            }
+            exponent += exponent_negative ? -e : e;
+            p = q;
+        }
+    }
+
+    double result = (double)mantissa;
+
+    if (mantissa != 0) {
+        if (exponent >= 0 && exponent <= 22)
+            result *= s_pow10[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            result /= s_pow10[-exponent];
+        else
+            result *= pow(10.0, (double)exponent);
+    }
+
+    *value = (float)(negative ? -result : result);
+
+    return p;
+}
+
+const char * ParseInt(const char * p, const char * end, int * value)
+{
+    bool negative = false;
+    unsigned long long result = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (p == end || *p < '0' || *p > '9')
+        return NULL;
+
+    // Anything that doesn't fit an int is treated as malformed
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        result = result * 10 + (*p - '0');
+        if (result > INT_MAX)
+            return NULL;
+    }
+
+    *value = negative ? -(int)result : (int)result;
+
+    return p;
+}
+
+void ComputeNormals(Mesh & mesh)
+{
+    size_t i;
+
+    mesh.normals.assign(mesh.positions.size(), 0.0f);
+    if (mesh.positions.empty())
+        return;
+
+    // The cross product of two edges is twice the triangle's area in length,
+    // so summing them unnormalized weights each face by its area
+    for (i = 0; i < mesh.indices.size(); i += 3) {
+        const unsigned int * tri = &mesh.indices[i];
+        const float * position = &mesh.positions[0];
+        const float * p0 = position + tri[0] * 3;
+        const float * p1 = position + tri[1] * 3;
+        const float * p2 = position + tri[2] * 3;
+        float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                       e1[2] * e2[0] - e1[0] * e2[2],
+                       e1[0] * e2[1] - e1[1] * e2[0] };
+        int corner, c;
+
+        for (corner = 0; corner < 3; corner++) {
+            for (c = 0; c < 3; c++)
+                mesh.normals[tri[corner] * 3 + c] += n[c];
+        }
+    }
+
+    for (i = 0; i < mesh.normals.size(); i += 3) {
+        float * n = &mesh.normals[i];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        if (length > 0.0f) {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        } else {
+            n[2] = 1.0f;
+        }
+    }
+}
+
+void RemapVertices(Mesh & mesh, const std::vector<unsigned int> & remap, size_t vertex_count)
+{
+    std::vector<float> positions(vertex_count * 3);
+    std::vector<float> normals(mesh.normals.empty() ? 0 : vertex_count * 3);
+    std::vector<float> texcoords(mesh.texcoords.empty() ? 0 : vertex_count * 2);
+    size_t i;
+
+    for (i = 0; i < remap.size(); i++) {
+        unsigned int v = remap[i];
+
+        if (v == ~0u)
+            continue;
+        memcpy(&positions[v * 3], &mesh.positions[i * 3], 3 * sizeof(float));
+        if (!normals.empty())
+            memcpy(&normals[v * 3], &mesh.normals[i * 3], 3 * sizeof(float));
+        if (!texcoords.empty())
+            memcpy(&texcoords[v * 2], &mesh.texcoords[i * 2], 2 * sizeof(float));
+    }
+
+    mesh.positions.swap(positions);
+    mesh.normals.swap(normals);
+    mesh.texcoords.swap(texcoords);
+}
+
+void WeldVertices(std::vector<Mesh> & frames)
+{
+    size_t vertex_count = frames.empty() ? 0 : frames[0].GetVertexCount();
+    size_t words = 0;
+    size_t frame, i, w;
+
+    for (frame = 0; frame < frames.size(); frame++)
+        words += 3 + (frames[frame].normals.empty() ? 0 : 3) + (frames[frame].texcoords.empty() ? 0 : 2);
+
+    std::vector<unsigned int> keys(vertex_count * words);
+    std::vector<unsigned int> remap(vertex_count);
+    std::vector<unsigned int> unique;
+
+    // Gather each vertex's attribute bits from every frame into one key so
+    // that comparing and hashing are straight word loops. Vertices are only
+    // merged if they coincide in all frames.
+    for (i = 0; i < vertex_count; i++) {
+        unsigned int * key = &keys[i * words];
+
+        for (frame = 0; frame < frames.size(); frame++) {
+            const Mesh & mesh = frames[frame];
+
+            memcpy(key, &mesh.positions[i * 3], 3 * sizeof(float));
+            key += 3;
+            if (!mesh.normals.empty()) {
+                memcpy(key, &mesh.normals[i * 3], 3 * sizeof(float));
+                key += 3;
+            }
+            if (!mesh.texcoords.empty()) {
+                memcpy(key, &mesh.texcoords[i * 2], 2 * sizeof(float));
+                key += 2;
+            }
+        }
+    }
+
+    size_t table_mask = 1023;
+    while (table_mask + 1 < vertex_count * 2)
+        table_mask = table_mask * 2 + 1;
+    std::vector<unsigned int> table(table_mask + 1, 0);
+
+    for (i = 0; i < vertex_count; i++) {
+        const unsigned int * key = &keys[i * words];
+        unsigned long long h = 0;
+
+        for (w = 0; w < words; w++)
+            h = (h ^ key[w]) * 0x100000001B3ull;
+        h ^= h >> 29;
+
+        size_t slot = (size_t)h & table_mask;
+
+        while (table[slot] != 0 && memcmp(&keys[unique[table[slot] - 1] * words], key, words * sizeof(unsigned int)) != 0)
+            slot = (slot + 1) & table_mask;
+
+        if (table[slot] == 0) {
+            unique.push_back((unsigned int)i);
+            table[slot] = (unsigned int)unique.size();
+        }
+
+        remap[i] = table[slot] - 1;
+    }
+
+    // Merged vertices are bitwise identical, so it doesn't matter which of
+    // them ends up being copied
+    for (frame = 0; frame < frames.size(); frame++) {
+        Mesh & mesh = frames[frame];
+
+        for (i = 0; i < mesh.indices.size(); i++)
+            mesh.indices[i] = remap[mesh.indices[i]];
+        RemapVertices(mesh, remap, unique.size());
+    }
+}
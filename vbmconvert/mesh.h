@@ -0,0 +1,138 @@
+#ifndef __MESH_H__
+#define __MESH_H__
+
+// Converter-side mesh representation. This only depends on the file type
+// definitions from vbm.h, never on GL.
+#define VBM_FILE_TYPES_ONLY
+#include "vbm.h"
+
+#include <stddef.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tokens written into VBM files (see the note at the top of vbm.h)
+#ifndef GL_UNSIGNED_INT
+#define GL_UNSIGNED_INT             0x1405
+#endif
+#ifndef GL_FLOAT
+#define GL_FLOAT                    0x1406
+#endif
+
+struct Mesh
+{
+    std::vector<float> positions;           // 3 per vertex
+    std::vector<float> normals;             // 3 per vertex, or empty
+    std::vector<float> texcoords;           // 2 per vertex, or empty
+    std::vector<unsigned int> indices;      // 3 per triangle
+    std::vector<VBM_MATERIAL> materials;
+
+    size_t GetVertexCount(void) const
+    {
+        return positions.size() / 3;
+    }
+
+    size_t GetTriangleCount(void) const
+    {
+        return indices.size() / 3;
+    }
+};
+
+// Read-only memory mapping of a whole file. Parsers work directly on the
+// mapped bytes, which are not NUL terminated.
+class MappedFile
+{
+public:
+    MappedFile(void);
+    ~MappedFile(void);
+
+    bool Open(const char * filename);
+    void Close(void);
+
+    const char * GetData(void) const
+    {
+        return m_data;
+    }
+
+    size_t GetSize(void) const
+    {
+        return m_size;
+    }
+
+protected:
+    const char * m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void * m_file;
+    void * m_mapping;
+#else
+    int m_fd;
+#endif
+};
+
+// Prints the time taken by each conversion stage as it completes
+class StageTimer
+{
+public:
+    StageTimer(void);
+
+    void Stage(const char * name);
+    double GetTotal(void) const;
+
+protected:
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_last;
+};
+
+// Number of worker threads used by the parallel stages
+extern unsigned int g_thread_count;
+
+// Runs func(0) .. func(count - 1), one call per thread
+template <typename F>
+void ParallelFor(unsigned int count, F func)
+{
+    std::vector<std::thread> threads;
+    unsigned int i;
+
+    for (i = 1; i < count; i++)
+        threads.push_back(std::thread(func, i));
+    if (count)
+        func(0);
+    for (i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+// Splits [begin, end) into up to count ranges that start at line
+// boundaries. bounds receives one more pointer than the number of ranges.
+void SplitLines(const char * begin, const char * end, unsigned int count, std::vector<const char *> & bounds);
+
+// Number parsing on non-terminated buffers. These return the position just
+// past the number, or NULL when there isn't one. ParseFloat trades exact
+// rounding for speed, which is fine for mesh data.
+const char * ParseFloat(const char * p, const char * end, float * value);
+const char * ParseInt(const char * p, const char * end, int * value);
+
+bool LoadOBJ(const char * filename, Mesh & mesh, StageTimer & timer);
+bool LoadPLY(const char * filename, Mesh & mesh, StageTimer & timer);
+
+// Moves the attributes of vertex i to remap[i], leaving vertex_count
+// vertices. Entries of ~0u drop the vertex. The indices are left alone.
+void RemapVertices(Mesh & mesh, const std::vector<unsigned int> & remap, size_t vertex_count);
+
+// Merges vertices whose attributes are bitwise identical in every frame.
+// The frames must all have the same vertex count and index buffer; they
+// keep sharing one after welding.
+void WeldVertices(std::vector<Mesh> & frames);
+
+// Area weighted vertex normals, used when the input doesn't carry any
+void ComputeNormals(Mesh & mesh);
+
+// Reorders triangles for the post-transform vertex cache, then vertices by
+// first use. Both only look at the index buffer. The vertex order is
+// returned in remap (as for RemapVertices) so that it can be applied to
+// other frames.
+void OptimizeVertexCache(Mesh & mesh);
+void OptimizeVertexFetch(Mesh & mesh, std::vector<unsigned int> & remap);
+
+#endif /* __MESH_H__ */
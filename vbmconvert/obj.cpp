@@ -0,0 +1,455 @@
+#include "mesh.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Marks a corner without a texture coordinate or normal
+#define OBJ_NONE                    (-0x7fffffff - 1)
+
+struct OBJ_CHUNK
+{
+    std::vector<float> v;               // 3 per position
+    std::vector<float> vt;              // 2 per texture coordinate
+    std::vector<float> vn;              // 3 per normal
+    std::vector<int> corners;           // (v, vt, vn) per triangle corner, 0-based
+    std::vector<size_t> relative;       // entries in corners that are relative to the chunk
+    std::vector<std::string> mtllibs;
+    bool error;
+};
+
+static inline const char * SkipSpace(const char * p, const char * end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+static inline bool IsSpace(const char * p, const char * end)
+{
+    return p < end && (*p == ' ' || *p == '\t');
+}
+
+static const char * ParseFloats(const char * p, const char * end, int count, std::vector<float> & out)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        float value;
+
+        p = ParseFloat(SkipSpace(p, end), end, &value);
+        if (p == NULL)
+            return NULL;
+        out.push_back(value);
+    }
+
+    return p;
+}
+
+static std::string ParseName(const char * p, const char * end)
+{
+    p = SkipSpace(p, end);
+    while (end > p && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+    return std::string(p, end);
+}
+
+// Parses a face line (after the 'f') and appends it as a triangle fan.
+// Negative (relative) indices can't be resolved until the sizes of the
+// preceding chunks are known, so they're stored relative to this chunk and
+// recorded for fixing up later.
+static bool ParseFace(const char * p, const char * end, OBJ_CHUNK & chunk, std::vector<int> & polygon)
+{
+    int counts[3] = { (int)(chunk.v.size() / 3), (int)(chunk.vt.size() / 2), (int)(chunk.vn.size() / 3) };
+
+    polygon.clear();
+    p = SkipSpace(p, end);
+
+    while (p < end && *p != '\r' && *p != '#') {
+        int k;
+
+        for (k = 0; k < 3; k++) {
+            int value = OBJ_NONE;
+            int relative = 0;
+
+            if (k > 0) {
+                if (p < end && *p == '/')
+                    p++;
+                else {
+                    polygon.push_back(OBJ_NONE);
+                    polygon.push_back(0);
+                    continue;
+                }
+            }
+
+            const char * q = ParseInt(p, end, &value);
+            if (q == NULL) {
+                // Only the position index is mandatory ("v//vn"); a number
+                // that is there but doesn't parse (too large) is an error
+                if (k == 0 || (p < end && ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+')))
+                    return false;
+                value = OBJ_NONE;
+            } else {
+                p = q;
+                if (value > 0) {
+                    value = value - 1;
+                } else if (value < 0) {
+                    value = counts[k] + value;
+                    relative = 1;
+                } else {
+                    return false;
+                }
+            }
+
+            polygon.push_back(value);
+            polygon.push_back(relative);
+        }
+
+        p = SkipSpace(p, end);
+    }
+
+    // Each polygon vertex is 6 ints: (index, relative) for v, vt and vn
+    size_t vertex_count = polygon.size() / 6;
+    size_t i;
+
+    if (vertex_count < 3)
+        return false;
+
+    for (i = 1; i + 1 < vertex_count; i++) {
+        size_t tri[3] = { 0, i, i + 1 };
+        int c, k;
+
+        for (c = 0; c < 3; c++) {
+            const int * vertex = &polygon[tri[c] * 6];
+
+            for (k = 0; k < 3; k++) {
+                if (vertex[k * 2 + 1])
+                    chunk.relative.push_back(chunk.corners.size());
+                chunk.corners.push_back(vertex[k * 2]);
+            }
+        }
+    }
+
+    return true;
+}
+
+static void ParseOBJChunk(const char * p, const char * end, OBJ_CHUNK & chunk)
+{
+    std::vector<int> polygon;
+
+    chunk.error = false;
+
+    while (p < end && !chunk.error) {
+        const char * line_end = (const char *)memchr(p, '\n', end - p);
+        if (line_end == NULL)
+            line_end = end;
+
+        p = SkipSpace(p, line_end);
+
+        if (p < line_end) {
+            if (p[0] == 'v') {
+                if (IsSpace(p + 1, line_end))
+                    chunk.error = ParseFloats(p + 1, line_end, 3, chunk.v) == NULL;
+                else if (p + 1 < line_end && p[1] == 't' && IsSpace(p + 2, line_end))
+                    chunk.error = ParseFloats(p + 2, line_end, 2, chunk.vt) == NULL;
+                else if (p + 1 < line_end && p[1] == 'n' && IsSpace(p + 2, line_end))
+                    chunk.error = ParseFloats(p + 2, line_end, 3, chunk.vn) == NULL;
+            } else if (p[0] == 'f' && IsSpace(p + 1, line_end)) {
+                chunk.error = !ParseFace(p + 1, line_end, chunk, polygon);
+            } else if (line_end - p > 7 && memcmp(p, "mtllib", 6) == 0 && IsSpace(p + 6, line_end)) {
+                chunk.mtllibs.push_back(ParseName(p + 6, line_end));
+            }
+            // Groups, objects, smoothing groups and usemtl are ignored since
+            // VBM files have no render chunks to map them onto
+        }
+
+        p = line_end + 1;
+    }
+}
+
+static void CopyName(char * dest, size_t size, const std::string & name)
+{
+    strncpy(dest, name.c_str(), size - 1);
+    dest[size - 1] = 0;
+}
+
+static bool LoadMTL(const std::string & filename, std::vector<VBM_MATERIAL> & materials)
+{
+    MappedFile file;
+
+    if (!file.Open(filename.c_str()))
+        return false;
+
+    const char * p = file.GetData();
+    const char * end = p + file.GetSize();
+    VBM_MATERIAL * material = NULL;
+
+    while (p < end) {
+        const char * line_end = (const char *)memchr(p, '\n', end - p);
+        std::vector<float> values;
+
+        if (line_end == NULL)
+            line_end = end;
+
+        p = SkipSpace(p, line_end);
+
+        const char * keyword = p;
+        while (p < line_end && *p != ' ' && *p != '\t' && *p != '\r')
+            p++;
+        std::string key(keyword, p);
+
+        if (key == "newmtl") {
+            materials.push_back(VBM_MATERIAL());
+            material = &materials.back();
+            memset(material, 0, sizeof(*material));
+            material->alpha = 1.0f;
+            material->ior = 1.0f;
+            CopyName(material->name, sizeof(material->name), ParseName(p, line_end));
+        } else if (material != NULL) {
+            VBM_VEC3F * color = NULL;
+
+            if (key == "Ka")
+                color = &material->ambient;
+            else if (key == "Kd")
+                color = &material->diffuse;
+            else if (key == "Ks")
+                color = &material->specular;
+            else if (key == "Tf")
+                color = &material->transmission;
+
+            if (color != NULL) {
+                if (ParseFloats(p, line_end, 3, values) != NULL) {
+                    color->x = values[0];
+                    color->y = values[1];
+                    color->z = values[2];
+                }
+            } else if (key == "Ns") {
+                if (ParseFloats(p, line_end, 1, values) != NULL) {
+                    material->shininess = values[0];
+                    material->specular_exp.x = material->specular_exp.y = material->specular_exp.z = values[0];
+                }
+            } else if (key == "d") {
+                if (ParseFloats(p, line_end, 1, values) != NULL)
+                    material->alpha = values[0];
+            } else if (key == "Tr") {
+                if (ParseFloats(p, line_end, 1, values) != NULL)
+                    material->alpha = 1.0f - values[0];
+            } else if (key == "Ni") {
+                if (ParseFloats(p, line_end, 1, values) != NULL)
+                    material->ior = values[0];
+            } else if (key == "map_Ka") {
+                CopyName(material->ambient_map, sizeof(material->ambient_map), ParseName(p, line_end));
+            } else if (key == "map_Kd") {
+                CopyName(material->diffuse_map, sizeof(material->diffuse_map), ParseName(p, line_end));
+            } else if (key == "map_Ks") {
+                CopyName(material->specular_map, sizeof(material->specular_map), ParseName(p, line_end));
+            } else if (key == "map_Bump" || key == "map_bump" || key == "bump" || key == "norm") {
+                CopyName(material->normal_map, sizeof(material->normal_map), ParseName(p, line_end));
+            }
+        }
+
+        p = line_end + 1;
+    }
+
+    return true;
+}
+
+static inline size_t HashCorner(const int * corner)
+{
+    unsigned long long h = (unsigned int)corner[0];
+
+    h = h * 0x9E3779B97F4A7C15ull + (unsigned int)corner[1];
+    h = h * 0x9E3779B97F4A7C15ull + (unsigned int)corner[2];
+    h ^= h >> 29;
+
+    return (size_t)h;
+}
+
+// Material libraries are looked up next to the OBJ file. A missing library
+// only loses its materials.
+static void LoadMaterials(const char * filename, const std::vector<std::string> & mtllibs, Mesh & mesh)
+{
+    std::string directory(filename);
+    size_t slash = directory.find_last_of("/\\");
+    size_t i;
+
+    directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+
+    mesh.materials.clear();
+    for (i = 0; i < mtllibs.size(); i++) {
+        if (!LoadMTL(directory + mtllibs[i], mesh.materials))
+            fprintf(stderr, "%s: unable to open material library '%s'\n", filename, mtllibs[i].c_str());
+    }
+}
+
+bool LoadOBJ(const char * filename, Mesh & mesh, StageTimer & timer)
+{
+    MappedFile file;
+    std::vector<const char *> bounds;
+    size_t i, c;
+
+    if (!file.Open(filename)) {
+        fprintf(stderr, "%s: unable to open file\n", filename);
+        return false;
+    }
+
+    SplitLines(file.GetData(), file.GetData() + file.GetSize(), g_thread_count, bounds);
+
+    std::vector<OBJ_CHUNK> chunks(bounds.size() - 1);
+
+    ParallelFor((unsigned int)chunks.size(), [&](unsigned int n) {
+        ParseOBJChunk(bounds[n], bounds[n + 1], chunks[n]);
+    });
+
+    timer.Stage("parse");
+
+    // Resolve chunk relative indices now that every chunk's size is known
+    std::vector<float> v, vt, vn;
+    std::vector<std::string> mtllibs;
+    size_t corner_count = 0;
+
+    for (i = 0; i < chunks.size(); i++) {
+        OBJ_CHUNK & chunk = chunks[i];
+        int base[3] = { (int)(v.size() / 3), (int)(vt.size() / 2), (int)(vn.size() / 3) };
+
+        if (chunk.error) {
+            fprintf(stderr, "%s: malformed vertex or face\n", filename);
+            return false;
+        }
+
+        for (c = 0; c < chunk.relative.size(); c++)
+            chunk.corners[chunk.relative[c]] += base[chunk.relative[c] % 3];
+
+        v.insert(v.end(), chunk.v.begin(), chunk.v.end());
+        vt.insert(vt.end(), chunk.vt.begin(), chunk.vt.end());
+        vn.insert(vn.end(), chunk.vn.begin(), chunk.vn.end());
+        mtllibs.insert(mtllibs.end(), chunk.mtllibs.begin(), chunk.mtllibs.end());
+        corner_count += chunk.corners.size() / 3;
+    }
+
+    // Texture coordinates are kept if any corner has them; normals only if
+    // every corner does, otherwise they get recomputed
+    int limits[3] = { (int)(v.size() / 3), (int)(vt.size() / 2), (int)(vn.size() / 3) };
+    bool has_texcoords = false;
+    bool has_normals = corner_count != 0;
+    bool positions_only = true;
+
+    for (i = 0; i < chunks.size(); i++) {
+        const std::vector<int> & corners = chunks[i].corners;
+
+        for (c = 0; c < corners.size(); c += 3) {
+            if (corners[c] < 0 || corners[c] >= limits[0] ||
+                (corners[c + 1] != OBJ_NONE && (corners[c + 1] < 0 || corners[c + 1] >= limits[1])) ||
+                (corners[c + 2] != OBJ_NONE && (corners[c + 2] < 0 || corners[c + 2] >= limits[2]))) {
+                fprintf(stderr, "%s: face index out of range\n", filename);
+                return false;
+            }
+            has_texcoords |= corners[c + 1] != OBJ_NONE;
+            has_normals &= corners[c + 2] != OBJ_NONE;
+            positions_only &= corners[c + 1] == OBJ_NONE && corners[c + 2] == OBJ_NONE;
+        }
+    }
+
+    // When faces only reference positions, vertices keep the numbering of
+    // the v lines, as they would in a PLY file. That lets keyframes from
+    // either format line up.
+    if (positions_only) {
+        mesh.positions.swap(v);
+        mesh.normals.clear();
+        mesh.texcoords.clear();
+        mesh.indices.resize(corner_count);
+        corner_count = 0;
+
+        for (i = 0; i < chunks.size(); i++) {
+            const std::vector<int> & corners = chunks[i].corners;
+
+            for (c = 0; c < corners.size(); c += 3)
+                mesh.indices[corner_count++] = (unsigned int)corners[c];
+        }
+
+        timer.Stage("index");
+        LoadMaterials(filename, mtllibs, mesh);
+        return true;
+    }
+
+    // Weld identical (v, vt, vn) corners with an open addressed hash table
+    // of vertex indices (+1, so zero marks an empty slot)
+    std::vector<int> keys;
+    std::vector<unsigned int> table;
+    size_t table_mask = 1023;
+
+    while (table_mask + 1 < limits[0] * 2u)
+        table_mask = table_mask * 2 + 1;
+    table.assign(table_mask + 1, 0);
+
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.texcoords.clear();
+    mesh.indices.resize(corner_count);
+    corner_count = 0;
+
+    for (i = 0; i < chunks.size(); i++) {
+        const std::vector<int> & corners = chunks[i].corners;
+
+        for (c = 0; c < corners.size(); c += 3) {
+            const int * corner = &corners[c];
+            size_t slot = HashCorner(corner) & table_mask;
+            unsigned int vertex;
+
+            while (table[slot] != 0) {
+                const int * key = &keys[(table[slot] - 1) * 3];
+                if (key[0] == corner[0] && key[1] == corner[1] && key[2] == corner[2])
+                    break;
+                slot = (slot + 1) & table_mask;
+            }
+
+            if (table[slot] != 0) {
+                vertex = table[slot] - 1;
+            } else {
+                vertex = (unsigned int)(keys.size() / 3);
+
+                keys.insert(keys.end(), corner, corner + 3);
+                table[slot] = vertex + 1;
+
+                // Keep the load factor under a half
+                if (keys.size() / 3 * 2 > table_mask) {
+                    size_t k;
+
+                    table_mask = table_mask * 2 + 1;
+                    table.assign(table_mask + 1, 0);
+                    for (k = 0; k < keys.size(); k += 3) {
+                        size_t s = HashCorner(&keys[k]) & table_mask;
+                        while (table[s] != 0)
+                            s = (s + 1) & table_mask;
+                        table[s] = (unsigned int)(k / 3) + 1;
+                    }
+                }
+            }
+
+            mesh.indices[corner_count++] = vertex;
+        }
+    }
+
+    size_t vertex_count = keys.size() / 3;
+
+    mesh.positions.resize(vertex_count * 3);
+    if (has_normals)
+        mesh.normals.resize(vertex_count * 3);
+    if (has_texcoords)
+        mesh.texcoords.assign(vertex_count * 2, 0.0f);
+
+    for (i = 0; i < vertex_count; i++) {
+        const int * key = &keys[i * 3];
+
+        memcpy(&mesh.positions[i * 3], &v[key[0] * 3], 3 * sizeof(float));
+        if (has_texcoords && key[1] != OBJ_NONE)
+            memcpy(&mesh.texcoords[i * 2], &vt[key[1] * 2], 2 * sizeof(float));
+        if (has_normals)
+            memcpy(&mesh.normals[i * 3], &vn[key[2] * 3], 3 * sizeof(float));
+    }
+
+    timer.Stage("index");
+
+    LoadMaterials(filename, mtllibs, mesh);
+
+    return true;
+}
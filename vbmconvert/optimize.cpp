@@ -0,0 +1,170 @@
+#include "mesh.h"
+
+#include <math.h>
+#include <string.h>
+
+// Vertex cache optimization after Tom Forsyth, "Linear-Speed Vertex Cache
+// Optimisation". Triangles are emitted greedily by a score that favours
+// vertices already in a simulated LRU cache and vertices with few
+// triangles left.
+#define VERTEX_CACHE_SIZE           32
+
+static float VertexScore(int cache_position, unsigned int live_triangles)
+{
+    float score = 0.0f;
+
+    if (live_triangles == 0)
+        return -1.0f;
+
+    if (cache_position >= 0) {
+        // The three vertices of the last triangle get a fixed score so that
+        // strips aren't favoured over fans
+        if (cache_position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - float(cache_position - 3) / float(VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+
+    return score + 2.0f / sqrtf((float)live_triangles);
+}
+
+void OptimizeVertexCache(Mesh & mesh)
+{
+    size_t vertex_count = mesh.GetVertexCount();
+    size_t triangle_count = mesh.GetTriangleCount();
+    size_t i;
+    int k;
+
+    if (triangle_count == 0)
+        return;
+
+    // Per-vertex lists of triangles that haven't been emitted yet
+    std::vector<unsigned int> live(vertex_count, 0);
+    std::vector<unsigned int> offset(vertex_count + 1, 0);
+    std::vector<unsigned int> adjacency(triangle_count * 3);
+
+    for (i = 0; i < triangle_count * 3; i++)
+        live[mesh.indices[i]]++;
+    for (i = 0; i < vertex_count; i++)
+        offset[i + 1] = offset[i] + live[i];
+    std::vector<unsigned int> fill(offset.begin(), offset.end() - 1);
+    for (i = 0; i < triangle_count * 3; i++)
+        adjacency[fill[mesh.indices[i]]++] = (unsigned int)(i / 3);
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    std::vector<float> triangle_score(triangle_count, 0.0f);
+    std::vector<bool> emitted(triangle_count, false);
+
+    for (i = 0; i < vertex_count; i++)
+        vertex_score[i] = VertexScore(-1, live[i]);
+    for (i = 0; i < triangle_count * 3; i++)
+        triangle_score[i / 3] += vertex_score[mesh.indices[i]];
+
+    std::vector<unsigned int> output;
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> new_cache;
+    size_t cursor = 0;
+    size_t best = 0;
+    float best_score = triangle_score[0];
+
+    output.reserve(triangle_count * 3);
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    new_cache.reserve(VERTEX_CACHE_SIZE + 3);
+
+    for (i = 1; i < triangle_count; i++) {
+        if (triangle_score[i] > best_score) {
+            best_score = triangle_score[i];
+            best = i;
+        }
+    }
+
+    while (output.size() < triangle_count * 3) {
+        const unsigned int * tri = &mesh.indices[best * 3];
+
+        emitted[best] = true;
+        output.insert(output.end(), tri, tri + 3);
+
+        // Take the triangle off its vertices' live lists and move the
+        // vertices to the front of the cache
+        new_cache.clear();
+        for (k = 0; k < 3; k++) {
+            unsigned int v = tri[k];
+            unsigned int * list = &adjacency[offset[v]];
+            unsigned int j;
+
+            for (j = 0; j < live[v]; j++) {
+                if (list[j] == best) {
+                    list[j] = list[live[v] - 1];
+                    break;
+                }
+            }
+            live[v]--;
+            new_cache.push_back(v);
+        }
+
+        for (i = 0; i < cache.size(); i++) {
+            if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                new_cache.push_back(cache[i]);
+        }
+
+        // Rescore everything that was or is in the cache, and the triangles
+        // using those vertices, picking the next triangle as we go
+        best_score = -1.0f;
+
+        for (i = 0; i < new_cache.size(); i++) {
+            unsigned int v = new_cache[i];
+            int position = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+            float old_score = vertex_score[v];
+            unsigned int j;
+
+            cache_position[v] = position;
+            vertex_score[v] = VertexScore(position, live[v]);
+
+            for (j = 0; j < live[v]; j++) {
+                unsigned int t = adjacency[offset[v] + j];
+
+                triangle_score[t] += vertex_score[v] - old_score;
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (new_cache.size() > VERTEX_CACHE_SIZE)
+            new_cache.resize(VERTEX_CACHE_SIZE);
+        cache.swap(new_cache);
+
+        // Nothing adjacent to the cache is left; restart from the next
+        // triangle in input order
+        if (best_score < 0.0f) {
+            while (cursor < triangle_count && emitted[cursor])
+                cursor++;
+            if (cursor == triangle_count)
+                break;
+            best = cursor;
+        }
+    }
+
+    mesh.indices.swap(output);
+}
+
+void OptimizeVertexFetch(Mesh & mesh, std::vector<unsigned int> & remap)
+{
+    unsigned int next = 0;
+    size_t i;
+
+    remap.assign(mesh.GetVertexCount(), ~0u);
+
+    for (i = 0; i < mesh.indices.size(); i++) {
+        unsigned int & v = mesh.indices[i];
+
+        if (remap[v] == ~0u)
+            remap[v] = next++;
+        v = remap[v];
+    }
+
+    // Unreferenced vertices are dropped along the way
+    RemapVertices(mesh, remap, next);
+}
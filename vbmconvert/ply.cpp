@@ -0,0 +1,568 @@
+#include "mesh.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+enum PLY_FORMAT
+{
+    PLY_ASCII,
+    PLY_BINARY_LITTLE_ENDIAN,
+    PLY_BINARY_BIG_ENDIAN
+};
+
+enum PLY_TYPE
+{
+    PLY_INVALID,
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+};
+
+static const size_t s_type_size[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+struct PLY_PROPERTY
+{
+    std::string name;
+    PLY_TYPE type;
+    PLY_TYPE count_type;                // PLY_INVALID unless this is a list
+};
+
+struct PLY_ELEMENT
+{
+    std::string name;
+    size_t count;
+    std::vector<PLY_PROPERTY> properties;
+};
+
+// Where each vertex attribute lives within a vertex, or -1
+struct PLY_VERTEX_LAYOUT
+{
+    int position[3];
+    int normal[3];
+    int texcoord[2];
+};
+
+static PLY_TYPE ParseType(const std::string & name)
+{
+    if (name == "char" || name == "int8")
+        return PLY_INT8;
+    if (name == "uchar" || name == "uint8")
+        return PLY_UINT8;
+    if (name == "short" || name == "int16")
+        return PLY_INT16;
+    if (name == "ushort" || name == "uint16")
+        return PLY_UINT16;
+    if (name == "int" || name == "int32")
+        return PLY_INT32;
+    if (name == "uint" || name == "uint32")
+        return PLY_UINT32;
+    if (name == "float" || name == "float32")
+        return PLY_FLOAT32;
+    if (name == "double" || name == "float64")
+        return PLY_FLOAT64;
+    return PLY_INVALID;
+}
+
+static double ReadBinary(const char * p, PLY_TYPE type, bool swap)
+{
+    unsigned char bytes[8];
+    size_t size = s_type_size[type];
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        bytes[i] = swap ? p[size - 1 - i] : p[i];
+
+    switch (type) {
+        case PLY_INT8:    { signed char v; memcpy(&v, bytes, 1); return v; }
+        case PLY_UINT8:   { unsigned char v; memcpy(&v, bytes, 1); return v; }
+        case PLY_INT16:   { short v; memcpy(&v, bytes, 2); return v; }
+        case PLY_UINT16:  { unsigned short v; memcpy(&v, bytes, 2); return v; }
+        case PLY_INT32:   { int v; memcpy(&v, bytes, 4); return v; }
+        case PLY_UINT32:  { unsigned int v; memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+        case PLY_FLOAT64: { double v; memcpy(&v, bytes, 8); return v; }
+        default:
+            return 0.0;
+    }
+}
+
+static inline const char * SkipSpace(const char * p, const char * end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
+
+static const char * NextLine(const char * p, const char * end)
+{
+    p = (const char *)memchr(p, '\n', end - p);
+    return p ? p + 1 : end;
+}
+
+static bool ParseHeader(const char * & p, const char * end, PLY_FORMAT & format, std::vector<PLY_ELEMENT> & elements)
+{
+    if (end - p < 4 || memcmp(p, "ply", 3) != 0)
+        return false;
+
+    p = NextLine(p, end);
+
+    while (p < end) {
+        const char * line_end = (const char *)memchr(p, '\n', end - p);
+        std::vector<std::string> words;
+
+        if (line_end == NULL)
+            return false;
+
+        const char * q = p;
+        while ((q = SkipSpace(q, line_end)) < line_end) {
+            const char * word = q;
+            while (q < line_end && *q != ' ' && *q != '\t' && *q != '\r')
+                q++;
+            words.push_back(std::string(word, q));
+        }
+
+        p = line_end + 1;
+
+        if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+            continue;
+
+        if (words[0] == "end_header")
+            return true;
+
+        if (words[0] == "format" && words.size() >= 2) {
+            if (words[1] == "ascii")
+                format = PLY_ASCII;
+            else if (words[1] == "binary_little_endian")
+                format = PLY_BINARY_LITTLE_ENDIAN;
+            else if (words[1] == "binary_big_endian")
+                format = PLY_BINARY_BIG_ENDIAN;
+            else
+                return false;
+        } else if (words[0] == "element" && words.size() >= 3) {
+            PLY_ELEMENT element;
+            element.name = words[1];
+            element.count = (size_t)strtoull(words[2].c_str(), NULL, 10);
+            elements.push_back(element);
+        } else if (words[0] == "property" && !elements.empty()) {
+            PLY_PROPERTY property;
+
+            if (words.size() >= 5 && words[1] == "list") {
+                property.count_type = ParseType(words[2]);
+                property.type = ParseType(words[3]);
+                property.name = words[4];
+                if (property.count_type == PLY_INVALID)
+                    return false;
+            } else if (words.size() >= 3) {
+                property.count_type = PLY_INVALID;
+                property.type = ParseType(words[1]);
+                property.name = words[2];
+            } else {
+                return false;
+            }
+
+            if (property.type == PLY_INVALID)
+                return false;
+
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    return false;
+}
+
+static int FindProperty(const PLY_ELEMENT & element, const char * name0, const char * name1 = NULL, const char * name2 = NULL)
+{
+    size_t i;
+
+    for (i = 0; i < element.properties.size(); i++) {
+        const std::string & name = element.properties[i].name;
+        if (element.properties[i].count_type == PLY_INVALID &&
+            (name == name0 || (name1 && name == name1) || (name2 && name == name2)))
+            return (int)i;
+    }
+
+    return -1;
+}
+
+static int FindIndexList(const PLY_ELEMENT & element)
+{
+    size_t i;
+
+    for (i = 0; i < element.properties.size(); i++) {
+        if (element.properties[i].count_type != PLY_INVALID &&
+            (element.properties[i].name == "vertex_indices" || element.properties[i].name == "vertex_index"))
+            return (int)i;
+    }
+
+    return -1;
+}
+
+static void StoreVertex(const double * values, const PLY_VERTEX_LAYOUT & layout, Mesh & mesh, size_t vertex)
+{
+    int c;
+
+    for (c = 0; c < 3; c++)
+        mesh.positions[vertex * 3 + c] = (float)values[layout.position[c]];
+    if (!mesh.normals.empty()) {
+        for (c = 0; c < 3; c++)
+            mesh.normals[vertex * 3 + c] = (float)values[layout.normal[c]];
+    }
+    if (!mesh.texcoords.empty()) {
+        for (c = 0; c < 2; c++)
+            mesh.texcoords[vertex * 2 + c] = (float)values[layout.texcoord[c]];
+    }
+}
+
+static void AppendPolygon(const std::vector<int> & polygon, std::vector<unsigned int> & indices)
+{
+    size_t i;
+
+    for (i = 1; i + 1 < polygon.size(); i++) {
+        indices.push_back(polygon[0]);
+        indices.push_back(polygon[i]);
+        indices.push_back(polygon[i + 1]);
+    }
+}
+
+// Finds where each of count ASCII lines starting at p begin, recording a
+// chunk boundary every (count / chunks) lines. Returns the end of the last line.
+static const char * SplitElementLines(const char * p, const char * end, size_t count, unsigned int chunks, std::vector<const char *> & bounds, std::vector<size_t> & first)
+{
+    size_t per_chunk = count / chunks + 1;
+    size_t i;
+
+    bounds.clear();
+    first.clear();
+
+    for (i = 0; i < count && p < end; i++) {
+        if (i % per_chunk == 0) {
+            bounds.push_back(p);
+            first.push_back(i);
+        }
+        p = NextLine(p, end);
+    }
+
+    bounds.push_back(p);
+    first.push_back(i);
+
+    return i == count ? p : NULL;
+}
+
+static bool ReadASCIIVertices(const char * & p, const char * end, const PLY_ELEMENT & element, const PLY_VERTEX_LAYOUT & layout, Mesh & mesh)
+{
+    std::vector<const char *> bounds;
+    std::vector<size_t> first;
+    const char * element_end = SplitElementLines(p, end, element.count, g_thread_count, bounds, first);
+    std::atomic<bool> error(false);
+
+    if (element_end == NULL)
+        return false;
+
+    ParallelFor((unsigned int)bounds.size() - 1, [&](unsigned int n) {
+        std::vector<double> values(element.properties.size());
+        const char * q = bounds[n];
+        size_t vertex;
+        size_t i;
+
+        for (vertex = first[n]; vertex < first[n + 1] && !error; vertex++) {
+            const char * line_end = (const char *)memchr(q, '\n', bounds[n + 1] - q);
+            if (line_end == NULL)
+                line_end = bounds[n + 1];
+
+            for (i = 0; i < element.properties.size(); i++) {
+                float value;
+                q = ParseFloat(SkipSpace(q, line_end), line_end, &value);
+                if (q == NULL || element.properties[i].count_type != PLY_INVALID) {
+                    error = true;
+                    break;
+                }
+                values[i] = value;
+            }
+
+            if (!error)
+                StoreVertex(&values[0], layout, mesh, vertex);
+            q = line_end + 1;
+        }
+    });
+
+    p = element_end;
+
+    return !error;
+}
+
+static bool ReadASCIIFaces(const char * & p, const char * end, const PLY_ELEMENT & element, int index_list, Mesh & mesh)
+{
+    std::vector<const char *> bounds;
+    std::vector<size_t> first;
+    const char * element_end = SplitElementLines(p, end, element.count, g_thread_count, bounds, first);
+    std::atomic<bool> error(false);
+
+    if (element_end == NULL)
+        return false;
+
+    std::vector<std::vector<unsigned int> > chunk_indices(bounds.size() - 1);
+
+    ParallelFor((unsigned int)bounds.size() - 1, [&](unsigned int n) {
+        std::vector<int> polygon;
+        const char * q = bounds[n];
+        size_t face;
+        size_t i;
+        int k;
+
+        for (face = first[n]; face < first[n + 1] && !error; face++) {
+            const char * line_end = (const char *)memchr(q, '\n', bounds[n + 1] - q);
+            if (line_end == NULL)
+                line_end = bounds[n + 1];
+
+            for (i = 0; i < element.properties.size() && q != NULL; i++) {
+                int count = 1;
+                float skipped;
+
+                if (element.properties[i].count_type != PLY_INVALID)
+                    q = ParseInt(SkipSpace(q, line_end), line_end, &count);
+
+                if ((int)i == index_list) {
+                    polygon.resize(count > 0 ? count : 0);
+                    for (k = 0; k < count && q != NULL; k++)
+                        q = ParseInt(SkipSpace(q, line_end), line_end, &polygon[k]);
+                } else {
+                    for (k = 0; k < count && q != NULL; k++)
+                        q = ParseFloat(SkipSpace(q, line_end), line_end, &skipped);
+                }
+            }
+
+            if (q == NULL) {
+                error = true;
+                break;
+            }
+
+            AppendPolygon(polygon, chunk_indices[n]);
+            q = line_end + 1;
+        }
+    });
+
+    for (size_t n = 0; n < chunk_indices.size(); n++)
+        mesh.indices.insert(mesh.indices.end(), chunk_indices[n].begin(), chunk_indices[n].end());
+
+    p = element_end;
+
+    return !error;
+}
+
+// Size of one element when it has no lists, zero otherwise
+static size_t FixedStride(const PLY_ELEMENT & element)
+{
+    size_t stride = 0;
+    size_t i;
+
+    for (i = 0; i < element.properties.size(); i++) {
+        if (element.properties[i].count_type != PLY_INVALID)
+            return 0;
+        stride += s_type_size[element.properties[i].type];
+    }
+
+    return stride;
+}
+
+// Reads one binary element into values (lists contribute their length
+// only), or appends a polygon when index_list matches. Returns NULL when
+// the data runs out.
+static const char * ReadBinaryElement(const char * p, const char * end, const PLY_ELEMENT & element, bool swap,
+                                      double * values, int index_list, std::vector<int> * polygon)
+{
+    size_t i;
+
+    for (i = 0; i < element.properties.size(); i++) {
+        const PLY_PROPERTY & property = element.properties[i];
+        size_t size = s_type_size[property.type];
+
+        if (property.count_type == PLY_INVALID) {
+            if ((size_t)(end - p) < size)
+                return NULL;
+            if (values)
+                values[i] = ReadBinary(p, property.type, swap);
+            p += size;
+        } else {
+            size_t count_size = s_type_size[property.count_type];
+
+            if ((size_t)(end - p) < count_size)
+                return NULL;
+
+            size_t count = (size_t)ReadBinary(p, property.count_type, swap);
+            p += count_size;
+
+            if ((size_t)(end - p) < count * size)
+                return NULL;
+
+            if ((int)i == index_list && polygon) {
+                size_t k;
+                polygon->resize(count);
+                for (k = 0; k < count; k++)
+                    (*polygon)[k] = (int)ReadBinary(p + k * size, property.type, swap);
+            }
+            p += count * size;
+        }
+    }
+
+    return p;
+}
+
+bool LoadPLY(const char * filename, Mesh & mesh, StageTimer & timer)
+{
+    MappedFile file;
+    PLY_FORMAT format = PLY_ASCII;
+    std::vector<PLY_ELEMENT> elements;
+    size_t e;
+
+    if (!file.Open(filename)) {
+        fprintf(stderr, "%s: unable to open file\n", filename);
+        return false;
+    }
+
+    const char * p = file.GetData();
+    const char * end = p + file.GetSize();
+
+    if (!ParseHeader(p, end, format, elements)) {
+        fprintf(stderr, "%s: invalid PLY header\n", filename);
+        return false;
+    }
+
+    bool swap = format == PLY_BINARY_BIG_ENDIAN;
+    unsigned int test = 1;
+    if (*(unsigned char *)&test == 0)
+        swap = format == PLY_BINARY_LITTLE_ENDIAN;
+
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.texcoords.clear();
+    mesh.indices.clear();
+    mesh.materials.clear();
+
+    for (e = 0; e < elements.size(); e++) {
+        const PLY_ELEMENT & element = elements[e];
+        bool ok = true;
+
+        if (element.name == "vertex") {
+            PLY_VERTEX_LAYOUT layout;
+
+            layout.position[0] = FindProperty(element, "x");
+            layout.position[1] = FindProperty(element, "y");
+            layout.position[2] = FindProperty(element, "z");
+            layout.normal[0] = FindProperty(element, "nx");
+            layout.normal[1] = FindProperty(element, "ny");
+            layout.normal[2] = FindProperty(element, "nz");
+            layout.texcoord[0] = FindProperty(element, "u", "s", "texture_u");
+            layout.texcoord[1] = FindProperty(element, "v", "t", "texture_v");
+
+            if (layout.position[0] < 0 || layout.position[1] < 0 || layout.position[2] < 0) {
+                fprintf(stderr, "%s: vertices have no position\n", filename);
+                return false;
+            }
+
+            mesh.positions.resize(element.count * 3);
+            if (layout.normal[0] >= 0 && layout.normal[1] >= 0 && layout.normal[2] >= 0)
+                mesh.normals.resize(element.count * 3);
+            if (layout.texcoord[0] >= 0 && layout.texcoord[1] >= 0)
+                mesh.texcoords.resize(element.count * 2);
+
+            size_t stride = FixedStride(element);
+
+            if (format == PLY_ASCII) {
+                ok = ReadASCIIVertices(p, end, element, layout, mesh);
+            } else if (stride != 0) {
+                // Fixed size vertices convert independently, so split them
+                // evenly between the threads
+                if ((size_t)(end - p) / stride < element.count) {
+                    ok = false;
+                } else {
+                    const char * data = p;
+
+                    ParallelFor(g_thread_count, [&](unsigned int n) {
+                        std::vector<double> values(element.properties.size());
+                        size_t first = element.count * n / g_thread_count;
+                        size_t last = element.count * (n + 1) / g_thread_count;
+                        size_t vertex;
+
+                        for (vertex = first; vertex < last; vertex++) {
+                            ReadBinaryElement(data + vertex * stride, end, element, swap, &values[0], -1, NULL);
+                            StoreVertex(&values[0], layout, mesh, vertex);
+                        }
+                    });
+                    p += element.count * stride;
+                }
+            } else {
+                std::vector<double> values(element.properties.size());
+                size_t vertex;
+
+                for (vertex = 0; vertex < element.count && p != NULL; vertex++) {
+                    p = ReadBinaryElement(p, end, element, swap, &values[0], -1, NULL);
+                    if (p != NULL)
+                        StoreVertex(&values[0], layout, mesh, vertex);
+                }
+                ok = p != NULL;
+            }
+        } else if (element.name == "face") {
+            int index_list = FindIndexList(element);
+
+            if (index_list < 0) {
+                fprintf(stderr, "%s: faces have no vertex indices\n", filename);
+                return false;
+            }
+
+            mesh.indices.reserve(element.count * 3);
+
+            if (format == PLY_ASCII) {
+                ok = ReadASCIIFaces(p, end, element, index_list, mesh);
+            } else {
+                // List lengths vary, so faces have to be walked in order
+                std::vector<int> polygon;
+                size_t face;
+
+                for (face = 0; face < element.count && p != NULL; face++) {
+                    p = ReadBinaryElement(p, end, element, swap, NULL, index_list, &polygon);
+                    AppendPolygon(polygon, mesh.indices);
+                }
+                ok = p != NULL;
+            }
+        } else {
+            // Skip elements we don't use
+            size_t i;
+
+            if (format == PLY_ASCII) {
+                for (i = 0; i < element.count && p < end; i++)
+                    p = NextLine(p, end);
+                ok = i == element.count;
+            } else {
+                for (i = 0; i < element.count && p != NULL; i++)
+                    p = ReadBinaryElement(p, end, element, swap, NULL, -1, NULL);
+                ok = p != NULL;
+            }
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s: malformed or truncated '%s' element\n", filename, element.name.c_str());
+            return false;
+        }
+    }
+
+    size_t i;
+    size_t vertex_count = mesh.GetVertexCount();
+
+    for (i = 0; i < mesh.indices.size(); i++) {
+        if (mesh.indices[i] >= vertex_count) {
+            fprintf(stderr, "%s: face index out of range\n", filename);
+            return false;
+        }
+    }
+
+    timer.Stage("parse");
+
+    return true;
+}
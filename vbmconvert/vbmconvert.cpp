@@ -0,0 +1,277 @@
+// vbmconvert - converts OBJ and PLY meshes to VBM files
+//
+// Each input becomes one frame of the output file, meant to be played back
+// as keyframe animation. Frames share a single vertex and index buffer, so
+// every input must have frame 0's topology. All frames are welded together
+// and reordered the same way as frame 0, so their vertices stay lined up.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh.h"
+
+static void Usage(void)
+{
+    printf("Usage: vbmconvert [options] output.vbm input.obj|input.ply [...]\n"
+           "\n"
+           "Each input becomes one frame of the output file. All inputs must\n"
+           "have the same vertices and faces as the first, in the same order.\n"
+           "\n"
+           "Options:\n"
+           "  -optimize     reorder triangles for the vertex cache and vertices\n"
+           "                for fetch locality\n"
+           "  -threads N    number of threads used for parsing (default: all cores)\n");
+}
+
+static bool HasExtension(const char * filename, const char * extension)
+{
+    size_t length = strlen(filename);
+    size_t extension_length = strlen(extension);
+    size_t i;
+
+    if (length < extension_length)
+        return false;
+
+    for (i = 0; i < extension_length; i++) {
+        char c = filename[length - extension_length + i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != extension[i])
+            return false;
+    }
+
+    return true;
+}
+
+static bool WriteVBM(const char * filename, const std::vector<Mesh> & frames)
+{
+    VBM_HEADER header;
+    std::vector<VBM_ATTRIB_HEADER> attribs;
+    std::vector<VBM_FRAME_HEADER> frame_headers;
+    std::vector<VBM_MATERIAL> materials;
+    bool has_texcoords = false;
+    size_t i, j;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = 0x314d4253;
+    header.size = sizeof(VBM_HEADER);
+
+    const char * name = filename + strlen(filename);
+    while (name > filename && name[-1] != '/' && name[-1] != '\\')
+        name--;
+    strncpy(header.name, name, sizeof(header.name) - 1);
+
+    // Frames are laid out one after the other, each indexing its own
+    // range of vertices
+    for (i = 0; i < frames.size(); i++) {
+        VBM_FRAME_HEADER frame;
+
+        frame.first = header.num_indices;
+        frame.count = (unsigned int)frames[i].indices.size();
+        frame.flags = 0;
+        frame_headers.push_back(frame);
+
+        header.num_vertices += (unsigned int)frames[i].GetVertexCount();
+        header.num_indices += frame.count;
+        has_texcoords |= !frames[i].texcoords.empty();
+
+        // Materials are merged by name
+        for (j = 0; j < frames[i].materials.size(); j++) {
+            size_t k;
+            for (k = 0; k < materials.size(); k++) {
+                if (strcmp(materials[k].name, frames[i].materials[j].name) == 0)
+                    break;
+            }
+            if (k == materials.size())
+                materials.push_back(frames[i].materials[j]);
+        }
+    }
+
+    static const char * attrib_names[] = { "position", "normal", "map1" };
+    static const unsigned int attrib_components[] = { 3, 3, 2 };
+
+    for (i = 0; i < (has_texcoords ? 3u : 2u); i++) {
+        VBM_ATTRIB_HEADER attrib;
+
+        memset(&attrib, 0, sizeof(attrib));
+        strcpy(attrib.name, attrib_names[i]);
+        attrib.type = GL_FLOAT;
+        attrib.components = attrib_components[i];
+        attribs.push_back(attrib);
+    }
+
+    header.num_attribs = (unsigned int)attribs.size();
+    header.num_frames = (unsigned int)frames.size();
+    header.index_type = GL_UNSIGNED_INT;
+    header.num_materials = (unsigned int)materials.size();
+    header.flags = VBM_FLAG_HAS_VERTICES | VBM_FLAG_HAS_INDICES | VBM_FLAG_HAS_FRAMES;
+    if (!materials.empty())
+        header.flags |= VBM_FLAG_HAS_MATERIALS;
+
+    FILE * f = fopen(filename, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: unable to create file\n", filename);
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(&attribs[0], sizeof(VBM_ATTRIB_HEADER), attribs.size(), f);
+    if (!frame_headers.empty())
+        fwrite(&frame_headers[0], sizeof(VBM_FRAME_HEADER), frame_headers.size(), f);
+
+    // Attributes are stored planar: all positions, then all normals, ...
+    for (i = 0; i < frames.size(); i++)
+        fwrite(frames[i].positions.data(), sizeof(float), frames[i].positions.size(), f);
+    for (i = 0; i < frames.size(); i++)
+        fwrite(frames[i].normals.data(), sizeof(float), frames[i].normals.size(), f);
+    if (has_texcoords) {
+        for (i = 0; i < frames.size(); i++) {
+            if (frames[i].texcoords.empty()) {
+                std::vector<float> zero(frames[i].GetVertexCount() * 2, 0.0f);
+                fwrite(zero.data(), sizeof(float), zero.size(), f);
+            } else {
+                fwrite(frames[i].texcoords.data(), sizeof(float), frames[i].texcoords.size(), f);
+            }
+        }
+    }
+
+    unsigned int base_vertex = 0;
+
+    for (i = 0; i < frames.size(); i++) {
+        std::vector<unsigned int> indices(frames[i].indices);
+
+        for (j = 0; j < indices.size(); j++)
+            indices[j] += base_vertex;
+        fwrite(indices.data(), sizeof(unsigned int), indices.size(), f);
+        base_vertex += (unsigned int)frames[i].GetVertexCount();
+    }
+
+    if (!materials.empty())
+        fwrite(&materials[0], sizeof(VBM_MATERIAL), materials.size(), f);
+
+    bool ok = ferror(f) == 0;
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (!ok)
+        fprintf(stderr, "%s: write failed\n", filename);
+
+    return ok;
+}
+
+int main(int argc, char ** argv)
+{
+    bool optimize = false;
+    int arg;
+
+    g_thread_count = std::thread::hardware_concurrency();
+    if (g_thread_count == 0)
+        g_thread_count = 1;
+
+    for (arg = 1; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-optimize") == 0) {
+            optimize = true;
+        } else if (strcmp(argv[arg], "-threads") == 0 && arg + 1 < argc) {
+            int count = atoi(argv[++arg]);
+            g_thread_count = count > 0 ? count : 1;
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (argc - arg < 2) {
+        Usage();
+        return 1;
+    }
+
+    const char * output = argv[arg++];
+    std::vector<Mesh> frames(argc - arg);
+    std::vector<unsigned int> fetch_remap;
+    size_t frame;
+    size_t total_triangles = 0;
+    double total_time = 0.0;
+
+    for (frame = 0; frame < frames.size(); frame++) {
+        const char * input = argv[arg + frame];
+        Mesh & mesh = frames[frame];
+        StageTimer timer;
+        bool loaded;
+
+        printf("%s\n", input);
+
+        if (HasExtension(input, ".obj")) {
+            loaded = LoadOBJ(input, mesh, timer);
+        } else if (HasExtension(input, ".ply")) {
+            loaded = LoadPLY(input, mesh, timer);
+        } else {
+            fprintf(stderr, "%s: unknown file type\n", input);
+            return 1;
+        }
+
+        if (!loaded)
+            return 1;
+
+        // Frames are only lined up vertex for vertex, so they must index
+        // the same vertices in the same way
+        if (frame > 0 && (mesh.GetVertexCount() != frames[0].GetVertexCount() || mesh.indices != frames[0].indices)) {
+            fprintf(stderr, "%s: topology differs from frame 0\n", input);
+            return 1;
+        }
+
+        total_time += timer.GetTotal();
+    }
+
+    // Vertices are merged only where they coincide in every frame, so all
+    // frames weld to the same topology
+    StageTimer weld_timer;
+
+    printf("%zu frames\n", frames.size());
+    WeldVertices(frames);
+    weld_timer.Stage("weld");
+    total_time += weld_timer.GetTotal();
+
+    for (frame = 0; frame < frames.size(); frame++) {
+        Mesh & mesh = frames[frame];
+        StageTimer timer;
+
+        printf("%s\n", argv[arg + frame]);
+
+        if (mesh.normals.empty()) {
+            ComputeNormals(mesh);
+            timer.Stage("normals");
+        }
+
+        if (optimize && frame == 0) {
+            OptimizeVertexCache(mesh);
+            timer.Stage("vertex cache");
+            OptimizeVertexFetch(mesh, fetch_remap);
+            timer.Stage("vertex fetch");
+        } else if (optimize) {
+            mesh.indices = frames[0].indices;
+            RemapVertices(mesh, fetch_remap, frames[0].GetVertexCount());
+            timer.Stage("reorder");
+        }
+
+        printf("  %zu vertices, %zu triangles, %zu materials\n",
+               mesh.GetVertexCount(), mesh.GetTriangleCount(), mesh.materials.size());
+
+        total_triangles += mesh.GetTriangleCount();
+        total_time += timer.GetTotal();
+    }
+
+    StageTimer timer;
+
+    printf("%s\n", output);
+    if (!WriteVBM(output, frames))
+        return 1;
+    timer.Stage("write");
+    total_time += timer.GetTotal();
+
+    printf("%zu frames, %zu triangles in %.1f ms (%.2f Mtris/s, %u threads)\n",
+           frames.size(), total_triangles, total_time,
+           total_time > 0.0 ? total_triangles / total_time / 1000.0 : 0.0, g_thread_count);
+
+    return 0;
+}